@@ -22,6 +22,8 @@ template<
 class HllEstimator {
 	static unsigned	constexpr	M		= 1u<<P;	// Number of Buckets
 	static float	constexpr	ALPHAM2	= M * (M * (0.7213/(1+(1.079/M)))); // for M >= 128
+	static unsigned	constexpr	RANKS	= H-P+2;	// Ranks 0 .. H-P+1
+	static_assert(RANKS <= HLL_RANKS, "Rank histogram does not fit output.");
 
 	/**
 	 * Exact accumulation until float conversion for output for M=2^P buckets:
@@ -36,39 +38,64 @@ class HllEstimator {
 	 * accumulator will then be ignored in favor of linear counting.
 	 */
 	using accu_t = ap_ufixed<H+1, P>;
-	ap_uint<P+1>	zeros	= 0;
 	accu_t			accu	= 0;
 
+	/**
+	 * Bucket count by rank. It is dumped after the estimate, two counts per
+	 * flit, so that the host can run a better estimator than the one above.
+	 */
+	ap_uint<P+1>	hist[HLL_RANKS] = { 0, };
+	bool			dump	= false;
+	ap_uint<clog2<HLL_RANKS/2>::value>	didx	= 0;
+
 public:
 	template<typename T_RANK>
 	void estimate(
 		hls::stream<flit_v_t<T_RANK>> &src,
-		hls::stream<float> &dst
+		hls::stream<float> &dst,
+		hls::stream<flit_v_t<ap_uint<64>>> &dst_hist
 	) {
 #pragma HLS pipeline II=1
-		if(!src.empty()) {
-			auto const  x = src.read();
-			T_RANK const  rank = x.val;
-			if(rank == 0)  zeros++;
-			accu_t  d = 0;		// d = 2^(-rank)
-			d[H-P+1 - rank] = 1;
-			accu += d;
-
-			if(x.last) {
-				// Raw Cardinality
-				float card = ALPHAM2 / accu.to_float();
-
-				// Estimate Refinement
-				if(card <= 2.5*M) {
-					// Linear Counting if there are empty Buckets
-					if(zeros != 0)  card = M*logf((float)M / (float)zeros);
+#pragma HLS array_partition variable=hist complete
+		if(!dump) {
+			if(!src.empty()) {
+				auto const  x = src.read();
+				T_RANK const  rank = x.val;
+				hist[rank]++;
+				accu_t  d = 0;		// d = 2^(-rank)
+				d[H-P+1 - rank] = 1;
+				accu += d;
+
+				if(x.last) {
+					ap_uint<P+1> const  zeros = hist[0];
+
+					// Raw Cardinality
+					float card = ALPHAM2 / accu.to_float();
+
+					// Estimate Refinement
+					if(card <= 2.5*M) {
+						// Linear Counting if there are empty Buckets
+						if(zeros != 0)  card = M*logf((float)M / (float)zeros);
+					}
+
+					// State Reset
+					accu = 0;
+					dump = true;
+
+					dst.write(card);
 				}
-
-				// State Reset
-				zeros = 0;
-				accu  = 0;
-
-				dst.write(card);
+			}
+		}
+		else {
+			bool const  olast = (didx == HLL_RANKS/2-1);
+			dst_hist.write(flit_v_t<ap_uint<64>>{ olast, (ap_uint<32>(hist[2*didx+1]), ap_uint<32>(hist[2*didx])) });
+			hist[2*didx]   = 0;
+			hist[2*didx+1] = 0;
+			didx++;
+
+			if(olast) {
+				didx = 0;
+				dump = false;
 			}
 		}
 	} // estimate()
@@ -83,7 +110,8 @@ using hashed_t = flit_v_t<T_HASH>;
 //- HLL ---------------------------------------------------------------------
 static void hll_sketch(
 	hls::stream<hashed_t>	(&hashed)[N],
-	hls::stream<float>		&cardest
+	hls::stream<float>		&cardest,
+	hls::stream<flit_v_t<ap_uint<64>>>	&hll_hist
 ) {
 #pragma HLS inline
 #pragma HLS interface ap_ctrl_none port=return
@@ -122,7 +150,7 @@ static void hll_sketch(
 	});
 
 	static HllEstimator<T_HASH::width, P_HLL>  estimator;
-	estimator.estimate(sketch_joined, cardest);
+	estimator.estimate(sketch_joined, cardest, hll_hist);
 
 } // hll_sketch()
 
@@ -341,6 +369,7 @@ static void compose(
 	hls::stream<bool>					&tick_src,
 	hls::stream<flit_v_t<ap_uint<64>>>	&dst_basic,
 	hls::stream<float>					&cardest,
+	hls::stream<flit_v_t<ap_uint<64>>>	&hll_hist,
 	hls::stream<ap_uint<64>>			(&agms_sums)[R_AGMS],
 	hls::stream<flit_v_t<ap_uint<W_CM>>>	&cm_counts,
 	hls::stream<flit_v_t<ap_uint<64>>>	&dst
@@ -353,7 +382,7 @@ static void compose(
 	}
 	cc++;
 
-	static ap_uint<clog2<R_AGMS+3>::value>  idx = 0;
+	static ap_uint<clog2<R_AGMS+4>::value>  idx = 0;
 
 	bool  ostb = false;
 	bool  olst;
@@ -389,6 +418,17 @@ static void compose(
 			idx++;
 		}
 	}
+	else if(idx == R_AGMS+2) {
+		if(!hll_hist.empty()) {
+			auto const  x = hll_hist.read();
+
+			ostb = true;
+			olst = false;
+			odat = x.val;
+
+			if(x.last)  idx++;
+		}
+	}
 	else {
 		if(!cm_counts.empty()) {
 			static struct { bool vld; ap_uint<32> val; } lo = { false, };
@@ -491,7 +531,9 @@ void krnl_skt_stream(
 	// Compute HLL Sketch
 	static hls::stream<float>  cardest;
 #pragma HLS aggregate variable=cardest
-	hll_sketch(hashed[0], cardest);
+	static hls::stream<flit_v_t<ap_uint<64>>>  hll_hist;
+#pragma HLS aggregate variable=hll_hist
+	hll_sketch(hashed[0], cardest, hll_hist);
 
 	// Compute AGMS Sketch
 	static hls::stream<ap_uint<64>>	agms_sums[R_AGMS];
@@ -504,7 +546,7 @@ void krnl_skt_stream(
 	// Compose Output
 	static hls::stream<flit_v_t<ap_uint<64>>>  dst0;
 #pragma HLS aggregate variable=dst0
-	compose(tick_src, dst_basic, cardest, agms_sums, cm_counts, dst0);
+	compose(tick_src, dst_basic, cardest, hll_hist, agms_sums, cm_counts, dst0);
 
 	map(dst0, dst, [](flit_v_t<ap_uint<64>> const& x) -> T_AXI64 {
 		T_AXI64  y;
@@ -19,6 +19,9 @@ static unsigned constexpr  CM_BITS = R_CM * P_CM;
 
 static unsigned constexpr  HASH_BITS = AGMS_BITS > CM_BITS? AGMS_BITS : CM_BITS;
 
+// HLL rank histogram output: ranks 0 .. HASH_BITS-P_HLL+1, padded to 64-bit flits
+static unsigned constexpr  HLL_RANKS = (HASH_BITS-P_HLL+2 + 1) & ~1u;
+
 //using Hash = ConcatHash<Murmur3_128<0xDEADF00D, (HASH_BITS+1)/2>, Murmur3_128<0xF00DBAAD, HASH_BITS/2>>;
 using Hash = hsl::Murmur3_128<0xDEADF00D, HASH_BITS>;
 
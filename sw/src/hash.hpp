@@ -27,6 +27,7 @@
 #ifndef HASH_HPP
 #define HASH_HPP
 
+#include <cstdint>
 #include <tuple>
 
 enum class hash_e : unsigned {
@@ -44,6 +45,23 @@ enum class hash_e : unsigned {
 
 typedef unsigned __int128 uint128_t;
 
+// Leading zeros of a non-zero hash word
+static inline unsigned clz_nz(uint32_t const  x) { return __builtin_clz(x); }
+static inline unsigned clz_nz(uint64_t const  x) { return __builtin_clzl(x); }
+static inline unsigned clz_nz(uint128_t const  x) { 
+    uint64_t hi, lo;
+    int b = 128;
+    if((hi = x>>64) != 0) {
+        b = __builtin_clzl(hi);
+    }
+    else
+        if ((lo = x & ~0ULL) != 0) {
+            b = __builtin_clzl(lo) + 64;
+        }
+
+    return b; 
+}
+
 template<typename T> char const *name_of(T  val);
 template<>           char const *name_of<hash_e>(hash_e  val);
 template<typename T> T      value_of(char const *name);
@@ -11,40 +11,52 @@
 int main(int  argc, char const *const  argv[]) {
 
 	// Evaluate Parameters
-	if(argc != 3) {
-		std::cerr << argv[0] << " <file> <threads>" << std::endl;
+	if((argc < 3) || (5 < argc)) {
+		std::cerr << argv[0] << " <file> <threads> [<collect_mode> [<key_bits:32/64>]]" << std::endl;
+		return -1;
+	}
+
+	// The file holds native-endian 32- or 64-bit keys
+	size_t const  key_bytes = (argc > 4)? atoi(argv[4])/8 : 4;
+	if((key_bytes != 4) && (key_bytes != 8)) {
+		std::cerr << "Key bits must be 32 or 64." << std::endl;
 		return -1;
 	}
 
 	boost::iostreams::mapped_file  ibuf(argv[1], std::ios_base::in);
-	uint32_t const *const  idata    = (uint32_t const*)ibuf.const_data();
-	size_t const           isize    = ibuf.size()/sizeof(uint32_t);
+	char const *const      idata    = ibuf.const_data();
+	size_t const           isize    = ibuf.size()/key_bytes;
 	unsigned const         nthreads = atoi(argv[2]);
 
 	std::cout << "Processing " << isize << " items by " << nthreads << " threads." << std::endl;
 	if(nthreads < 1)  return  0;
 
+	// ATOMIC: all threads share a single collector
+	collect_e const  mode = (argc > 3)? value_of<collect_e>(argv[3]) : collect_e::DIRECT;
+	if(mode == collect_e::end) {
+		std::cerr << "Unknown collect mode '" << argv[3] << '\'' << std::endl;
+		return -1;
+	}
+	unsigned const  ncollectors = (mode == collect_e::ATOMIC)? 1 : nthreads;
+
 	std::vector<SktCollector> collectors;
-	collectors.reserve(nthreads);
+	collectors.reserve(ncollectors);
 	hash_e const  hash = value_of<hash_e>("MURMUR3_128");
+	for(unsigned  i = 0; i < ncollectors; i++)  collectors.emplace_back(13, 5, 13, 5, 13, hash, mode);
 
 	// Distribute data to partial sketches
 	std::thread  workers[nthreads];
 	for(unsigned  i = 0; i < nthreads; i++) {
-		collectors.emplace_back(13, 5, 13, 5, 13, hash);
-		SktCollector &collector = collectors.back();
-		workers[i] = std::thread([&collector, data = &idata[i*isize/nthreads], size = (i+1)*isize/nthreads - i*isize/nthreads](){
-			collector.collect(data, size);
+		SktCollector &collector = collectors[i % ncollectors];
+		workers[i] = std::thread([&collector, key_bytes, data = &idata[key_bytes*(i*isize/nthreads)], size = (i+1)*isize/nthreads - i*isize/nthreads](){
+			if(key_bytes == 4)  collector.collect((uint32_t const*)data, size);
+			else                collector.collect((uint64_t const*)data, size);
 		});
 	}
 
 	// Compact into first Table
-	workers[0].join();
-	SktCollector &master_collector = collectors.front();
-	for(unsigned  i = 1; i < nthreads; i++) {
-		workers[i].join();
-		master_collector.merge(collectors[i]);
-	}
+	for(std::thread &t : workers)  t.join();
+	SktCollector::merge_tree(collectors.data(), ncollectors, nthreads);
 
 	double const  cardest = collectors[0].estimate_cardinality();
 	std::cout  << "Estimated cardinality: " << cardest << std::endl;
@@ -73,7 +73,8 @@ int fillRandomData(uint32_t* block, uint64_t sizeInTuples, std::string fileName)
    return 0;
 }
 
-void fillRandomDataLocal(uint32_t* block, uint64_t sizeInTuples,uint32_t repet) {
+template<typename T>
+void fillRandomDataLocal(T* block, uint64_t sizeInTuples,uint32_t repet) {
 
    for(unsigned i = 0; i < (((unsigned)sizeInTuples)/repet); i++) {
         for(unsigned j=0; j<repet; j++) 
@@ -82,10 +83,10 @@ void fillRandomDataLocal(uint32_t* block, uint64_t sizeInTuples,uint32_t repet)
 
 }
 
-void call_from_thread(int threadNumber, uint32_t* pBuffer, uint32_t transferTuples, int openedSocket, int repetitions){
+void call_from_thread(int threadNumber, void const* pBuffer, uint32_t transferTuples, size_t tupleBytes, int openedSocket, int repetitions){
   //  set_cpu(threadNumber%NUM_CORES);
   char const *const  buf = (char const*)pBuffer;
-  size_t      const  len = transferTuples * sizeof(uint32_t);
+  size_t      const  len = transferTuples * tupleBytes;
 
   for(int r=0; r<repetitions; r++){
     size_t  cnt = 0;
@@ -109,7 +110,8 @@ int main(int argc, char *argv[]) {
                                   ("repetitions,r", boost::program_options::value<uint32_t>(), "Number of repetitions")
                                   ("address", boost::program_options::value<std::string>(), "Master ip address")
                                   ("threads", boost::program_options::value<int>(), "Threads")
-                                  ("datafile,f", boost::program_options::value<std::string>(), "Data file");
+                                  ("datafile,f", boost::program_options::value<std::string>(), "Data file")
+                                  ("keybits,k", boost::program_options::value<unsigned>(), "Key bits: 32 (default) or 64");
 
   boost::program_options::variables_map commandLineArgs;
   boost::program_options::store(boost::program_options::parse_command_line(argc, argv, programDescription), commandLineArgs);
@@ -147,12 +149,22 @@ int main(int argc, char *argv[]) {
      return -1;
   }
    
+  size_t tupleBytes = sizeof(Tuple);
+  if (commandLineArgs.count("keybits") > 0) {
+     tupleBytes = commandLineArgs["keybits"].as<unsigned>()/8;
+     if(tupleBytes != 4 && tupleBytes != 8) {
+       std::cerr << "Key bits must be 32 or 64.\n";
+       return -1;
+     }
+  }
+
   sizePerConn = sizeInTuples/numThreads; 
-  uint64_t inputSize = sizePerConn * sizeof(Tuple);
+  uint64_t inputSize = sizePerConn * tupleBytes;
    
   std::cout << "Number of Threads : " << numThreads << std::endl;  
   std::cout << "Number of tuples  : " << sizeInTuples*numberRepetitions << std::endl;
   std::cout << "Tuples per Connect: " << sizePerConn << std::endl;
+  std::cout << "Key Bits          : " << 8*tupleBytes << std::endl;
   std::cout << "TranferSize       : " << ((double)inputSize*numThreads*numberRepetitions)/1000.0/1000.0/1000.0 << "[GB]" << std::endl;
   
   //std::cout << "Cardinality     : " << cardinality << std::endl;
@@ -163,7 +175,7 @@ int main(int argc, char *argv[]) {
     std::cout << "Master address  : " << masterAddr << std::endl;
   }
 
-  uint32_t* dataBuffer =  (uint32_t*) malloc(inputSize);
+  void* dataBuffer = malloc(inputSize);
 
   //sender
   double durationUs = 0.0;
@@ -173,7 +185,8 @@ int main(int argc, char *argv[]) {
   std::cout<<"Start filling in the memory!"<<std::endl;  
   //if( fillRandomData(dataBuffer, sizePerConn, file) !=0 )
   //  return -1;
-  fillRandomDataLocal(dataBuffer,sizePerConn,1);
+  if(tupleBytes == sizeof(uint32_t))  fillRandomDataLocal((uint32_t*)dataBuffer,sizePerConn,1);
+  else                                fillRandomDataLocal((uint64_t*)dataBuffer,sizePerConn,1);
   std::cout<<"End filling in the memory!"<<std::endl;
 
   //  barrier = new barrier_t[numberRepetitions+1];
@@ -218,7 +231,7 @@ int main(int argc, char *argv[]) {
   for(int i=0; i<numThreads; i++){
     //Launch threads
     //call_from_thread(uint32_t* pBuffer, uint32_t transferTuples, int socket)
-    t[i] = std::thread(call_from_thread, i, dataBuffer, sizePerConn, sockfd[i], numberRepetitions);  
+    t[i] = std::thread(call_from_thread, i, dataBuffer, sizePerConn, tupleBytes, sockfd[i], numberRepetitions);  
   }
   // auto start = std::chrono::high_resolution_clock::now();
     
@@ -4,6 +4,8 @@
 
 #include <vector>
 #include <thread>
+#include <cstdint>
+#include <cstdlib>
 
 #include <strings.h>
 #include <unistd.h>
@@ -14,20 +16,32 @@
 
 
 int main(int  argc, char const *const  argv[]) {
-	if(argc != 4) {
-		std::cerr << argv[0] << " <file> <server_address> <threads>" << std::endl;
+	if((argc < 4) || (5 < argc)) {
+		std::cerr << argv[0] << " <file> <server_address> <threads> [<key_bits:32/64>]" << std::endl;
 		return -1;
 	}
-	std::vector<uint32_t>  ibuf; {
+	// Keys are sent as native-endian 32- or 64-bit words
+	size_t const  key_bytes = (argc > 4)? atoi(argv[4])/8 : 4;
+	if((key_bytes != 4) && (key_bytes != 8)) {
+		std::cerr << "Key bits must be 32 or 64." << std::endl;
+		return -1;
+	}
+	std::vector<char>  ibuf; {
 		std::ifstream  ifs(argv[1]);
 		while(true) {
-			uint32_t  v;
+			uint64_t  v;
 			ifs >> v;
 			if(!ifs)  break;
-			ibuf.emplace_back(v);
+			if((key_bytes == 4) && (v > UINT32_MAX)) {
+				std::cerr << "Key " << v << " does not fit 32 bits." << std::endl;
+				return -1;
+			}
+			uint32_t const  w = v;
+			char const *const  key = (key_bytes == 4)? (char const*)&w : (char const*)&v;
+			ibuf.insert(ibuf.end(), key, key+key_bytes);
 		}
 	}
-	auto const  isize = ibuf.size();
+	auto const  isize = ibuf.size()/key_bytes;
 
 	struct sockaddr_in  server_addr;
 	bzero(&server_addr, sizeof(server_addr));
@@ -41,7 +55,7 @@ int main(int  argc, char const *const  argv[]) {
 
 	std::thread  workers[nthreads];
 	for(unsigned  i = 0; i < nthreads; i++) {
-		workers[i] = std::thread([&server_addr, obuf = (char const*)&ibuf[i*isize/nthreads], olen = ((i+1)*isize/nthreads - i*isize/nthreads)*sizeof(uint32_t)]() {
+		workers[i] = std::thread([&server_addr, obuf = &ibuf[key_bytes*(i*isize/nthreads)], olen = ((i+1)*isize/nthreads - i*isize/nthreads)*key_bytes]() {
 			auto const  sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
 			if(connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) != 0) {
 				std::cerr << "Connection to Server failed ..." << std::endl;
@@ -27,9 +27,10 @@
 
 unsigned constexpr  JOB_SIZE = 1u<<16;
 
+// Holds JOB_SIZE 32-bit or JOB_SIZE/2 64-bit keys
 struct Job {
-    size_t    cnt;
-    uint32_t  buf[JOB_SIZE];
+    size_t              cnt;
+    alignas(8) uint8_t  buf[4*JOB_SIZE];
 };
 
 class JobQueue {
@@ -70,8 +71,8 @@ public:
 int main(int argc, char *argv[]) {
 
     //- Parse Parameters ----------------------------------------------------
-    if(argc != 3) {
-        std::cerr << "Usage: " << argv[0] << " <hash:MURMUR3_128/64> <threads>[x<collectors>]" << std::endl;
+    if((argc < 3) || (6 < argc)) {
+        std::cerr << "Usage: " << argv[0] << " <hash:MURMUR3_128/64> <threads>[x<collectors>] [<collect_mode> [<key_bits:32/64> [<window_s>[/<sub_windows>]]]]" << std::endl;
         return  EXIT_FAILURE;
     }
 
@@ -88,12 +89,46 @@ int main(int argc, char *argv[]) {
         return  EXIT_FAILURE;
     }
 
-    std::cout << "Threads: " << threads << 'x' << mul_collectors << std::endl;
+    // ATOMIC: all collecting threads share a single collector
+    collect_e const  mode = (argc > 3)? value_of<collect_e>(argv[3]) : collect_e::DIRECT;
+    if(mode == collect_e::end) {
+        std::cerr << "Unknown collect mode '" << argv[3] << '\'' << std::endl;
+        return  EXIT_FAILURE;
+    }
+    bool const  shared = mode == collect_e::ATOMIC;
+
+    // The stream is a sequence of native-endian 32- or 64-bit keys
+    unsigned const  key_bytes = (argc > 4)? strtoul(argv[4], NULL, 10)/8 : 4;
+    if((key_bytes != 4) && (key_bytes != 8)) {
+        std::cerr << "Key bits must be 32 or 64." << std::endl;
+        return  EXIT_FAILURE;
+    }
+
+    // Sliding window: the sketches cover the last window_s seconds in steps of
+    // window_s/sub_windows and are reported after every step
+    unsigned const  window_s = (argc > 5)? strtoul(argv[5], &endp, 10) : 0;
+    unsigned const  window_n = (window_s && (*endp == '/'))? strtoul(endp+1, NULL, 10) : 10;
+    if((argc > 5) && ((window_s <= 0) || (window_n <= 0) || (1000*window_s < window_n))) {
+        std::cerr << "Window must be at least 1 s and sub-windows at least 1 ms." << std::endl;
+        return  EXIT_FAILURE;
+    }
+    if(window_s && shared) {
+        std::cerr << "Windows take one writer each and cannot be shared." << std::endl;
+        return  EXIT_FAILURE;
+    }
+    unsigned const  tick_ms = 1000*window_s / window_n;
+
+    std::cout << "Threads: " << threads << 'x' << mul_collectors << (shared? " (shared collector)" : "") << ", Key Bits: " << 8*key_bytes << std::endl;
 
     std::vector<SktCollector> collectors;
-    for(unsigned i = 0; i < threads*mul_collectors; i++) {
-        collectors.emplace_back(13, 5, 13, 5, 13, hash);
+    std::vector<SktWindow>    windows;
+    windows.reserve(window_s? threads*mul_collectors : 0);
+    for(unsigned i = 0; i < (shared? 1 : threads*mul_collectors); i++) {
+        if(window_s)  windows.emplace_back(13, 5, 13, 5, 13, hash, window_n);
+        else          collectors.emplace_back(13, 5, 13, 5, 13, hash, mode);
     }
+    std::unique_ptr<std::mutex[]>  windowLocks(new std::mutex[windows.size()]);
+    if(window_s)  std::cout << "Window: " << window_s << " s in " << window_n << " steps of " << tick_ms << " ms" << std::endl;
 
 
     //- Open Server Socket --------------------------------------------------
@@ -125,19 +160,59 @@ int main(int argc, char *argv[]) {
     std::atomic<size_t>    itemCount(0);
     decltype(std::chrono::system_clock::now())  t0;
 
+    // Window ticks count from server start
+    auto const  tStart = std::chrono::steady_clock::now();
+    auto const  tickNow = [tStart, tick_ms]() -> uint64_t {
+        return  std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - tStart).count() / tick_ms;
+    };
+    // Merges the snapshots of all windows into the first one
+    auto const  windowSnapshot = [&windows, &windowLocks, &tickNow]() {
+        std::vector<SktCollector>  snaps;
+        for(size_t  i = 0; i < windows.size(); i++) {
+            std::lock_guard<std::mutex>  lock(windowLocks[i]);
+            windows[i].advance(tickNow());
+            snaps.push_back(windows[i].snapshot());
+        }
+        SktCollector::merge_tree(snaps.data(), snaps.size(), 1);
+        return  std::move(snaps[0]);
+    };
+
+    std::mutex               reportMtx;
+    std::condition_variable  reportCv;
+    bool                     reportDone = false;
+    std::thread  reporter;
+    if(window_s) {
+        reporter = std::thread([&, window_s]() {
+            std::unique_lock<std::mutex>  lock(reportMtx);
+            for(uint64_t  tick = tickNow()+1;; tick++) {
+                if(reportCv.wait_until(lock, tStart + std::chrono::milliseconds(tick*tick_ms), [&reportDone]() { return  reportDone; }))  break;
+                SktCollector  snap = windowSnapshot();
+                std::cout << "Last " << window_s << " s: Cardinality: " << snap.estimate_cardinality() << ", F2: " << snap.estimate_f2() << std::endl;
+            }
+        });
+    }
+
     std::thread  tid[threads];
     for(unsigned i = 0; i < threads; i++) {
-        tid[i] = std::thread([serverSocket, &connectCount, &t0, &itemCount, collects = &collectors[i*mul_collectors], mul_collectors](){
+        tid[i] = std::thread([serverSocket, &connectCount, &t0, &itemCount, collects = window_s? nullptr : &collectors[shared? 0 : i*mul_collectors],
+                              wins = window_s? &windows[i*mul_collectors] : nullptr, locks = window_s? &windowLocks[i*mul_collectors] : nullptr, &tickNow, shared, mul_collectors, key_bytes](){
             JobQueue  jobsFree(mul_collectors+1);
             JobQueue  jobsFull;
 
             std::thread  slaves[mul_collectors];
             for(unsigned  i = 0; i < mul_collectors; i++) {
-                slaves[i] = std::thread([&jobsFull, &jobsFree, &collect = collects[i], &itemCount](){
+                slaves[i] = std::thread([&jobsFull, &jobsFree, collect = collects? &collects[shared? 0 : i] : nullptr, win = wins? &wins[i] : nullptr, lock = locks? &locks[i] : nullptr, &tickNow, &itemCount, key_bytes](){
                     while(true) {
                         Job *const  job = jobsFull.pop();
                         if(!job)  break;
-                        collect.collect(job->buf, job->cnt);
+                        if(win) {
+                            std::lock_guard<std::mutex>  guard(*lock);
+                            win->advance(tickNow());
+                            if(key_bytes == 4)  win->collect((uint32_t const*)job->buf, job->cnt);
+                            else                win->collect((uint64_t const*)job->buf, job->cnt);
+                        }
+                        else if(key_bytes == 4)  collect->collect((uint32_t const*)job->buf, job->cnt);
+                        else                     collect->collect((uint64_t const*)job->buf, job->cnt);
                         itemCount += job->cnt;
                         jobsFree.push(job);
                     }
@@ -147,20 +222,20 @@ int main(int argc, char *argv[]) {
             int const  sock = accept(serverSocket, NULL, NULL);
             if(connectCount++ == 0)  t0 = std::chrono::system_clock::now();
 
+            // Bytes of a key split across two receives are carried into the next job
             size_t    cnt = 0;
-            uint32_t  cy;
+            uint8_t   cy[8];
             while(true) {
                 Job *const  job = jobsFree.pop();
 
-                char *ptr = (char*)job->buf;
-                *(uint32_t*)ptr = cy;
-                ssize_t const  n = recv(sock, ptr+cnt, sizeof(job->buf)-cnt, MSG_WAITALL);
-                if(!n)  break;
+                memcpy(job->buf, cy, cnt);
+                ssize_t const  n = recv(sock, job->buf+cnt, sizeof(job->buf)-cnt, MSG_WAITALL);
+                if(n <= 0)  break;
                 cnt += n;
 
-                size_t const  items = cnt/sizeof(uint32_t);
-                cnt %= sizeof(uint32_t);
-                if(cnt)  cy = job->buf[items];
+                size_t const  items = cnt/key_bytes;
+                cnt %= key_bytes;
+                memcpy(cy, job->buf + items*key_bytes, cnt);
                 job->cnt = items;
                 jobsFull.push(job);
             }
@@ -175,16 +250,22 @@ int main(int argc, char *argv[]) {
     for(std::thread &t : tid)  t.join();
     auto const  t1 = std::chrono::system_clock::now();
     close(serverSocket);
+    if(window_s) {
+        {
+            std::lock_guard<std::mutex>  lock(reportMtx);
+            reportDone = true;
+        }
+        reportCv.notify_one();
+        reporter.join();
+        // Report on the last window
+        collectors.push_back(windowSnapshot());
+    }
 
     // Compact into first Table 
-    for(unsigned  i = 1; i < threads*mul_collectors; i++) {
-        collectors[0].merge(collectors[i]);
-    }
+    SktCollector::merge_tree(collectors.data(), collectors.size(), std::max(1u, std::thread::hardware_concurrency()));
     double const  cardest = collectors[0].estimate_cardinality();
 
-    SktCollector collector_cols(0, 6, 1, 0, 0, hash); 
-    collector_cols.merge_columns(collectors[0]);
-    double const  median = collector_cols.get_median();
+    double const  f2est = collectors[0].estimate_f2();
 
     auto const t2 = std::chrono::system_clock::now();
 
@@ -193,9 +274,10 @@ int main(int argc, char *argv[]) {
 
     std::cout
         << "Item Count: " << itemCount.load() << '\n'
-        << "Collect Throughput [GB/s]: " << sizeof(uint32_t) * itemCount.load() / d0 << '\n'
-        << "Total Throughput   [GB/s]: " << sizeof(uint32_t) * itemCount.load() / d1 << '\n'
-        << "Cardinality: " << cardest << std::endl;
+        << "Collect Throughput [GB/s]: " << key_bytes * itemCount.load() / d0 << '\n'
+        << "Total Throughput   [GB/s]: " << key_bytes * itemCount.load() / d1 << '\n'
+        << "Cardinality: " << cardest << '\n'
+        << "F2: " << f2est << std::endl;
 
     return 0;
 }
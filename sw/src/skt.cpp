@@ -25,6 +25,7 @@
  * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
 #include "skt.hpp"
+#include "barrier.hpp"
 
 #include <map>
 #include <vector>
@@ -32,6 +33,18 @@
 #include <limits>
 #include <cstring>
 #include <cmath>
+#include <stdexcept>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <new>
+#include <exception>
+#include <pthread.h>
+#include <cstdlib>
+#include <sys/mman.h>
+
+#include <immintrin.h>
 
 //---------------------------------------------------------------------------
 // Utilities for hash_e enum
@@ -72,23 +85,628 @@ hash_e value_of<hash_e>(char const *name) {
 }
 
 //---------------------------------------------------------------------------
-// Hash-based Dispatch Table
-std::array<SktCollector::dispatch_t, (unsigned)hash_e::end> const  SktCollector::DISPATCH {
-    SktCollector::dispatch_t { skt_collect_ptr<hash_e::IDENT>         },
-    SktCollector::dispatch_t { skt_collect_ptr<hash_e::SIP>           },
-    SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_32>    },
-    SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_64>    },
-    SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_128>    },
+// Utilities for collect_e enum
+template<>
+char const *name_of<collect_e>(collect_e  val) {
+    static char const *LOOKUP[(unsigned)collect_e::end] = {
+        "DIRECT",
+        "BLOCKED",
+        "PREFETCH",
+        "RADIX",
+        "CONSERVATIVE",
+        "ATOMIC",
+        "PARTITIONED",
+    };
+    return  val < collect_e::end? LOOKUP[(unsigned)val] : "<undef>";
+}
+
+template<>
+collect_e value_of<collect_e>(char const *name) {
+    static std::map<char const*, collect_e, std::function<bool(char const*, char const*)>> const  LOOKUP {
+        {
+            { "DIRECT",             collect_e::DIRECT },
+            { "BLOCKED",            collect_e::BLOCKED },
+            { "PREFETCH",           collect_e::PREFETCH },
+            { "RADIX",              collect_e::RADIX },
+            { "CONSERVATIVE",       collect_e::CONSERVATIVE },
+            { "ATOMIC",             collect_e::ATOMIC },
+            { "PARTITIONED",        collect_e::PARTITIONED },
+        },
+        [](char const *a, char const *b) { return  strcmp(a, b) < 0; }
+    };
+    auto const  res = LOOKUP.find(name);
+    return  res != LOOKUP.end()? res->second : collect_e::end;
+}
+
+//---------------------------------------------------------------------------
+// Utilities for layout_e enum
+template<>
+char const *name_of<layout_e>(layout_e  val) {
+    static char const *LOOKUP[(unsigned)layout_e::end] = {
+        "ROWS",
+        "LINES",
+    };
+    return  val < layout_e::end? LOOKUP[(unsigned)val] : "<undef>";
+}
+
+template<>
+layout_e value_of<layout_e>(char const *name) {
+    static std::map<char const*, layout_e, std::function<bool(char const*, char const*)>> const  LOOKUP {
+        {
+            { "ROWS",               layout_e::ROWS },
+            { "LINES",              layout_e::LINES },
+        },
+        [](char const *a, char const *b) { return  strcmp(a, b) < 0; }
+    };
+    auto const  res = LOOKUP.find(name);
+    return  res != LOOKUP.end()? res->second : layout_e::end;
+}
+
+//---------------------------------------------------------------------------
+// Utilities for pages_e enum
+template<>
+char const *name_of<pages_e>(pages_e  val) {
+    static char const *LOOKUP[(unsigned)pages_e::end] = {
+        "SMALL",
+        "THP",
+        "HUGETLB",
+    };
+    return  val < pages_e::end? LOOKUP[(unsigned)val] : "<undef>";
+}
+
+template<>
+pages_e value_of<pages_e>(char const *name) {
+    static std::map<char const*, pages_e, std::function<bool(char const*, char const*)>> const  LOOKUP {
+        {
+            { "SMALL",              pages_e::SMALL },
+            { "THP",                pages_e::THP },
+            { "HUGETLB",            pages_e::HUGETLB },
+        },
+        [](char const *a, char const *b) { return  strcmp(a, b) < 0; }
+    };
+    auto const  res = LOOKUP.find(name);
+    return  res != LOOKUP.end()? res->second : pages_e::end;
+}
+
+//---------------------------------------------------------------------------
+// Table Memory
+
+// Heap slabs are zeroed here, mapped ones come zeroed from the kernel and get
+// their pages on first touch, i.e. on the node of the first collecting thread.
+SktCollector::slab_t SktCollector::slab_alloc(size_t const bytes, pages_e const pages) {
+    if(pages >= pages_e::end)  throw std::invalid_argument("Unknown page kind.");
+    if(!bytes)  return  slab_t(nullptr, slab_deleter { 0 });
+    if((pages != pages_e::SMALL) && (bytes >= SKT_HUGE_PAGE)) {
+        size_t const  len = (bytes + SKT_HUGE_PAGE-1) & ~(SKT_HUGE_PAGE-1);
+        void  *slab = MAP_FAILED;
+        if(pages == pages_e::HUGETLB)  slab = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(slab == MAP_FAILED) {
+            slab = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if(slab == MAP_FAILED)  throw std::bad_alloc();
+            madvise(slab, len, MADV_HUGEPAGE);
+        }
+        return  slab_t((uint8_t*)slab, slab_deleter { len });
+    }
+    void *const  slab = aligned_alloc(64, slab_align(bytes));
+    if(!slab)  throw std::bad_alloc();
+    memset(slab, 0, slab_align(bytes));
+    return  slab_t((uint8_t*)slab, slab_deleter { 0 });
+}
+
+void SktCollector::slab_deleter::operator()(uint8_t *slab) const {
+    if(size)  munmap(slab, size);
+    else      free(slab);
+}
+
+//---------------------------------------------------------------------------
+// Mode- and Hash-based Dispatch Table
+#ifdef INCLUDE_AVX_HASHES
+#define DISPATCH_AVX(MODE) \
+        SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_32AVX, MODE>, skt_collect_ptr<hash_e::MURMUR3_32AVX, MODE>, skt_collect_str_ptr<hash_e::MURMUR3_32AVX, MODE> }, \
+        SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_64AVX, MODE>, skt_collect_ptr<hash_e::MURMUR3_64AVX, MODE>, skt_collect_str_ptr<hash_e::MURMUR3_64AVX, MODE> },
+#else
+#define DISPATCH_AVX(MODE)
+#endif
+#define DISPATCH_MODE(MODE) \
+    std::array<SktCollector::dispatch_t, (unsigned)hash_e::end> { \
+        SktCollector::dispatch_t { skt_collect_ptr<hash_e::IDENT,       MODE>, skt_collect_ptr<hash_e::IDENT,       MODE>, nullptr }, \
+        SktCollector::dispatch_t { skt_collect_ptr<hash_e::SIP,         MODE>, skt_collect_ptr<hash_e::SIP,         MODE>, skt_collect_str_ptr<hash_e::SIP,         MODE> }, \
+        SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_32,  MODE>, skt_collect_ptr<hash_e::MURMUR3_32,  MODE>, skt_collect_str_ptr<hash_e::MURMUR3_32,  MODE> }, \
+        SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_64,  MODE>, skt_collect_ptr<hash_e::MURMUR3_64,  MODE>, skt_collect_str_ptr<hash_e::MURMUR3_64,  MODE> }, \
+        SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_128, MODE>, skt_collect_ptr<hash_e::MURMUR3_128, MODE>, skt_collect_str_ptr<hash_e::MURMUR3_128, MODE> }, \
+        DISPATCH_AVX(MODE) \
+    }
+
+std::array<std::array<SktCollector::dispatch_t, (unsigned)hash_e::end>, (unsigned)collect_e::end> const  SktCollector::DISPATCH {
+    DISPATCH_MODE(collect_e::DIRECT),
+    DISPATCH_MODE(collect_e::BLOCKED),
+    DISPATCH_MODE(collect_e::PREFETCH),
+    DISPATCH_MODE(collect_e::RADIX),
+    DISPATCH_MODE(collect_e::CONSERVATIVE),
+    DISPATCH_MODE(collect_e::ATOMIC),
+    DISPATCH_MODE(collect_e::PARTITIONED),
+};
+#undef DISPATCH_MODE
+#undef DISPATCH_AVX
+
+//---------------------------------------------------------------------------
+// Weighted Collection
 #ifdef INCLUDE_AVX_HASHES
-    SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_32AVX> },
-    SktCollector::dispatch_t { skt_collect_ptr<hash_e::MURMUR3_64AVX> },
+#define WEIGHTED_AVX(MODE) \
+        SktCollector::weighted_t { skt_collect_weighted_ptr<hash_e::MURMUR3_32AVX, MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_32AVX, MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_32AVX, MODE> }, \
+        SktCollector::weighted_t { skt_collect_weighted_ptr<hash_e::MURMUR3_64AVX, MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_64AVX, MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_64AVX, MODE> },
+#else
+#define WEIGHTED_AVX(MODE)
 #endif
+#define WEIGHTED_MODE(MODE) \
+    std::array<SktCollector::weighted_t, (unsigned)hash_e::end> { \
+        SktCollector::weighted_t { skt_collect_weighted_ptr<hash_e::IDENT,       MODE>, skt_collect_weighted_ptr<hash_e::IDENT,       MODE>, nullptr }, \
+        SktCollector::weighted_t { skt_collect_weighted_ptr<hash_e::SIP,         MODE>, skt_collect_weighted_ptr<hash_e::SIP,         MODE>, skt_collect_weighted_ptr<hash_e::SIP,         MODE> }, \
+        SktCollector::weighted_t { skt_collect_weighted_ptr<hash_e::MURMUR3_32,  MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_32,  MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_32,  MODE> }, \
+        SktCollector::weighted_t { skt_collect_weighted_ptr<hash_e::MURMUR3_64,  MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_64,  MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_64,  MODE> }, \
+        SktCollector::weighted_t { skt_collect_weighted_ptr<hash_e::MURMUR3_128, MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_128, MODE>, skt_collect_weighted_ptr<hash_e::MURMUR3_128, MODE> }, \
+        WEIGHTED_AVX(MODE) \
+    }
+
+std::array<std::array<SktCollector::weighted_t, (unsigned)hash_e::end>, (unsigned)collect_e::end> const  SktCollector::WEIGHTED {
+    WEIGHTED_MODE(collect_e::DIRECT),
+    WEIGHTED_MODE(collect_e::BLOCKED),
+    WEIGHTED_MODE(collect_e::PREFETCH),
+    WEIGHTED_MODE(collect_e::RADIX),
+    WEIGHTED_MODE(collect_e::CONSERVATIVE),
+    WEIGHTED_MODE(collect_e::ATOMIC),
+    WEIGHTED_MODE(collect_e::PARTITIONED),
 };
+#undef WEIGHTED_MODE
+#undef WEIGHTED_AVX
+
+// Prefer a backend specialized for the exact geometry, fall back to the generic one.
+SktCollector::dispatch_t SktCollector::select(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, collect_e const mode, layout_e const layout) {
+    if(layout >= layout_e::end)  throw std::invalid_argument("Unknown table layout.");
+    if(ar_val > SKT_MAX_ROWS || cr_val > SKT_MAX_ROWS)  throw std::invalid_argument("Too many sketch rows.");
+    dispatch_t const &generic = DISPATCH.at((unsigned)mode).at((unsigned)hash);
+    if(layout != layout_e::ROWS)  return  generic;
+    skt_collect_fn   const  fixed   = skt_collect_fixed_ptr  (hash, mode, hp_val, ar_val, ap_val, cr_val, cp_val);
+    skt_collect64_fn const  fixed64 = skt_collect_fixed64_ptr(hash, mode, hp_val, ar_val, ap_val, cr_val, cp_val);
+    return  dispatch_t { fixed? fixed : generic.f_ptr, fixed64? fixed64 : generic.f_ptr64, generic.f_str };
+}
+
+// LINES packs 2^g slots of every row into a block of at most one cache line
+// (16 counters) so that an item touches one, or for unaligned blocks two, lines
+// per table. g never drops below min_g, so very tall tables get larger blocks.
+unsigned SktCollector::granule(layout_e const layout, unsigned const rows, unsigned const p, unsigned const min_g) {
+    unsigned constexpr  LINE = 64/sizeof(unsigned);
+
+    if(layout == layout_e::ROWS)  return  p;
+    unsigned  g = std::min(min_g, p);
+    while((g < p) && ((size_t)rows << (g+1)) <= LINE)  g++;
+    return  g;
+}
+
+unsigned SktCollector::hash_bits(hash_e const hash) {
+    switch(hash) {
+    case hash_e::SIP:
+    case hash_e::MURMUR3_64:
+#ifdef INCLUDE_AVX_HASHES
+    case hash_e::MURMUR3_64AVX:
+#endif
+        return  64;
+    case hash_e::MURMUR3_128:
+        return  128;
+    default:
+        return  32;
+    }
+}
+
+//---------------------------------------------------------------------------
+// Sparse HLL
+#ifdef INCLUDE_AVX_HASHES
+#define SPARSE_AVX \
+    SktCollector::sparse_t { skt_hll_sparse_ptr<hash_e::MURMUR3_32AVX>, skt_hll_sparse_ptr<hash_e::MURMUR3_32AVX>, skt_hll_sparse_str_ptr<hash_e::MURMUR3_32AVX> }, \
+    SktCollector::sparse_t { skt_hll_sparse_ptr<hash_e::MURMUR3_64AVX>, skt_hll_sparse_ptr<hash_e::MURMUR3_64AVX>, skt_hll_sparse_str_ptr<hash_e::MURMUR3_64AVX> },
+#else
+#define SPARSE_AVX
+#endif
+std::array<SktCollector::sparse_t, (unsigned)hash_e::end> const  SktCollector::SPARSE {
+    SktCollector::sparse_t { skt_hll_sparse_ptr<hash_e::IDENT>, skt_hll_sparse_ptr<hash_e::IDENT>, nullptr },
+    SktCollector::sparse_t { skt_hll_sparse_ptr<hash_e::SIP>, skt_hll_sparse_ptr<hash_e::SIP>, skt_hll_sparse_str_ptr<hash_e::SIP> },
+    SktCollector::sparse_t { skt_hll_sparse_ptr<hash_e::MURMUR3_32>, skt_hll_sparse_ptr<hash_e::MURMUR3_32>, skt_hll_sparse_str_ptr<hash_e::MURMUR3_32> },
+    SktCollector::sparse_t { skt_hll_sparse_ptr<hash_e::MURMUR3_64>, skt_hll_sparse_ptr<hash_e::MURMUR3_64>, skt_hll_sparse_str_ptr<hash_e::MURMUR3_64> },
+    SktCollector::sparse_t { skt_hll_sparse_ptr<hash_e::MURMUR3_128>, skt_hll_sparse_ptr<hash_e::MURMUR3_128>, skt_hll_sparse_str_ptr<hash_e::MURMUR3_128> },
+    SPARSE_AVX
+};
+#undef SPARSE_AVX
+
+// Keeps the larger rank per sparse index, grows the set at half load. The set
+// takes 4 bytes per slot: rather than grow past half the size of the dense
+// registers it is replaced by them, so it never outgrows them.
+void SktCollector::sparse_insert(uint32_t const  entry) {
+    size_t   const  mask = m_sparse_hll.size()-1;
+    uint32_t const  key  = entry >> 7;
+    for(size_t i = key & mask;; i = (i+1) & mask) {
+        uint32_t &slot = m_sparse_hll[i];
+        if(slot == 0) {
+            slot = entry;
+            m_sparse_cnt++;
+            break;
+        }
+        if((slot >> 7) == key) {
+            if(slot < entry)  slot = entry;
+            return;
+        }
+    }
+
+    if(2*m_sparse_cnt > m_sparse_hll.size()) {
+        if(16*m_sparse_hll.size() > (size_t(1) << m_p_hll)) {
+            densify();
+            return;
+        }
+        std::vector<uint32_t>  old(2*m_sparse_hll.size(), 0);
+        old.swap(m_sparse_hll);
+        m_sparse_cnt = 0;
+        for(uint32_t const  e : old) {
+            if(e)  sparse_insert(e);
+        }
+    }
+}
+
+// Folds the sparse registers into dense ones. The index bits beyond m_p_hll
+// become the leading part of the dense rank, which makes the result identical
+// to dense collection.
+void SktCollector::sparse_fold(uint8_t *buckets) const {
+    unsigned const  shift = SKT_HLL_SPARSE_P - m_p_hll;
+    uint32_t const  mask  = (UINT32_C(1) << shift)-1;
+
+    // Branch-free as the free slots are interspersed at random: they fold a 0 into register 0.
+    for(uint32_t const  e : m_sparse_hll) {
+        uint32_t const  idx  = e >> 7;
+        uint32_t const  w    = idx & mask;
+        unsigned const  rank = (w? shift - (31 - __builtin_clz(w|1)) : (e & 0x7F) + shift) & -(unsigned)(e != 0);
+        uint8_t  *const  bucket = &buckets[idx >> shift];
+        *bucket = std::max<unsigned>(*bucket, rank);
+    }
+}
+
+void SktCollector::densify() {
+    m_slab_hll = slab_alloc(size_t(1) << m_p_hll, m_pages);
+    m_buckets_hll = &m_slab_hll[0];
+    sparse_fold(&m_buckets_hll[0]);
+    std::vector<uint32_t>().swap(m_sparse_hll);
+    m_sparse_cnt = 0;
+}
+
+// Null weights count every item once. Stops right after the item whose insert densified.
+template<typename D>
+size_t SktCollector::sparse_stage(D const data, int32_t const *weights, size_t  n) {
+    uint32_t  entries[512];
+    for(size_t ofs = 0; ofs < n; ofs += 512) {
+        size_t const  cnt = std::min<size_t>(n-ofs, 512);
+        m_sparse_fn.of(data)(data+ofs, cnt, entries);
+        for(size_t i = 0; i < cnt; i++) {
+            if(weights && (weights[ofs+i] <= 0))  continue;
+            sparse_insert(entries[i]);
+            if(m_buckets_hll)  return  ofs+i+1;
+        }
+    }
+    return  n;
+}
+
+template<typename D>
+void SktCollector::collect_sparse(D const data, size_t  n) {
+    size_t const  ofs = sparse_stage(data, nullptr, n);
+
+    // AGMS and CM see all items, dense HLL registers only those past the switch.
+    auto const  fn = m_dispatch.of(data);
+    fn(data, ofs, nullptr, &m_table_agms[0], &m_table_cm[0],
+       m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm, m_pf_dist);
+    if(ofs < n) {
+        fn(data+ofs, n-ofs, &m_buckets_hll[0], &m_table_agms[0], &m_table_cm[0],
+           m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm, m_pf_dist);
+    }
+}
+template void SktCollector::collect_sparse(uint32_t const *data, size_t  n);
+template void SktCollector::collect_sparse(uint64_t const *data, size_t  n);
+template void SktCollector::collect_sparse(skt_strings_t data, size_t  n);
+
+template<typename D>
+void SktCollector::collect_sparse_weighted(D const data, int32_t const *weights, size_t  n) {
+    // Rejected before the sparse registers see any of the items
+    if(!m_weighted_fn.of(data))  throw std::invalid_argument("IDENT cannot hash string keys.");
+    size_t const  ofs = sparse_stage(data, weights, n);
+
+    auto const  fn = m_weighted_fn.of(data);
+    fn(data, weights, ofs, nullptr, &m_table_agms[0], &m_table_cm[0],
+       m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm);
+    if(ofs < n) {
+        fn(data+ofs, weights+ofs, n-ofs, &m_buckets_hll[0], &m_table_agms[0], &m_table_cm[0],
+           m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm);
+    }
+}
+template void SktCollector::collect_sparse_weighted(uint32_t const *data, int32_t const *weights, size_t  n);
+template void SktCollector::collect_sparse_weighted(uint64_t const *data, int32_t const *weights, size_t  n);
+template void SktCollector::collect_sparse_weighted(skt_strings_t data, int32_t const *weights, size_t  n);
+
+//---------------------------------------------------------------------------
+// Point Queries
+#ifdef INCLUDE_AVX_HASHES
+#define QUERY_AVX \
+    SktCollector::query_t { skt_query_ptr<hash_e::MURMUR3_32AVX>, skt_query_ptr<hash_e::MURMUR3_32AVX>, skt_query_str_ptr<hash_e::MURMUR3_32AVX> }, \
+    SktCollector::query_t { skt_query_ptr<hash_e::MURMUR3_64AVX>, skt_query_ptr<hash_e::MURMUR3_64AVX>, skt_query_str_ptr<hash_e::MURMUR3_64AVX> },
+#else
+#define QUERY_AVX
+#endif
+std::array<SktCollector::query_t, (unsigned)hash_e::end> const  SktCollector::QUERY {
+    SktCollector::query_t { skt_query_ptr<hash_e::IDENT>, skt_query_ptr<hash_e::IDENT>, nullptr },
+    SktCollector::query_t { skt_query_ptr<hash_e::SIP>, skt_query_ptr<hash_e::SIP>, skt_query_str_ptr<hash_e::SIP> },
+    SktCollector::query_t { skt_query_ptr<hash_e::MURMUR3_32>, skt_query_ptr<hash_e::MURMUR3_32>, skt_query_str_ptr<hash_e::MURMUR3_32> },
+    SktCollector::query_t { skt_query_ptr<hash_e::MURMUR3_64>, skt_query_ptr<hash_e::MURMUR3_64>, skt_query_str_ptr<hash_e::MURMUR3_64> },
+    SktCollector::query_t { skt_query_ptr<hash_e::MURMUR3_128>, skt_query_ptr<hash_e::MURMUR3_128>, skt_query_str_ptr<hash_e::MURMUR3_128> },
+    QUERY_AVX
+};
+#undef QUERY_AVX
+
+//---------------------------------------------------------------------------
+// Partitioned Collection
+#ifdef INCLUDE_AVX_HASHES
+#define ROUTE_AVX \
+    SktCollector::route_t { skt_route_ptr<hash_e::MURMUR3_32AVX>, skt_route_ptr<hash_e::MURMUR3_32AVX> }, \
+    SktCollector::route_t { skt_route_ptr<hash_e::MURMUR3_64AVX>, skt_route_ptr<hash_e::MURMUR3_64AVX> },
+#else
+#define ROUTE_AVX
+#endif
+std::array<SktCollector::route_t, (unsigned)hash_e::end> const  SktCollector::ROUTE {
+    SktCollector::route_t { skt_route_ptr<hash_e::IDENT>, skt_route_ptr<hash_e::IDENT> },
+    SktCollector::route_t { skt_route_ptr<hash_e::SIP>, skt_route_ptr<hash_e::SIP> },
+    SktCollector::route_t { skt_route_ptr<hash_e::MURMUR3_32>, skt_route_ptr<hash_e::MURMUR3_32> },
+    SktCollector::route_t { skt_route_ptr<hash_e::MURMUR3_64>, skt_route_ptr<hash_e::MURMUR3_64> },
+    SktCollector::route_t { skt_route_ptr<hash_e::MURMUR3_128>, skt_route_ptr<hash_e::MURMUR3_128> },
+    ROUTE_AVX
+};
+#undef ROUTE_AVX
+
+// Items routed per step, updates per inbox cell and cells per inbox (a power of 2)
+static size_t constexpr  SKT_ROUTE_TILE = 256;
+static size_t constexpr  SKT_CELL_SIZE  = 256;
+static size_t constexpr  SKT_INBOX_SIZE = 32;
+
+// Multi-producer single-consumer inbox of update batches, one per owner. A
+// bounded queue after Vyukov: the sequence of a cell tells whether it is free
+// for position pos (seq == pos) or holds the batch of pos (seq == pos+1).
+struct skt_inbox_t {
+    struct cell_t {
+        std::atomic<size_t>  seq;
+        size_t               cnt;
+        uint64_t             upd[SKT_CELL_SIZE];
+    };
+    alignas(64) std::atomic<size_t>  tail;     // producer position
+    alignas(64) size_t               head;     // consumer position
+    std::unique_ptr<cell_t[]>        cells;
+
+    skt_inbox_t() : tail(0), head(0), cells(new cell_t[SKT_INBOX_SIZE]) {
+        for(size_t i = 0; i < SKT_INBOX_SIZE; i++)  cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    // Pushes upd[0..cnt) as one batch, returns false while the inbox is full
+    bool push(uint64_t const *upd, size_t const  cnt) {
+        size_t  pos = tail.load(std::memory_order_relaxed);
+        for(;;) {
+            cell_t &c = cells[pos & (SKT_INBOX_SIZE-1)];
+            size_t const  seq = c.seq.load(std::memory_order_acquire);
+            if(seq == pos) {
+                if(!tail.compare_exchange_weak(pos, pos+1, std::memory_order_relaxed))  continue;
+                memcpy(c.upd, upd, cnt*sizeof(uint64_t));
+                c.cnt = cnt;
+                c.seq.store(pos+1, std::memory_order_release);
+                return  true;
+            }
+            if((intptr_t)(seq - pos) < 0)  return  false;
+            pos = tail.load(std::memory_order_relaxed);
+        }
+    }
+    // Applies all published batches, returns their update count
+    template<typename F>
+    size_t drain(F const &apply) {
+        size_t  k = 0;
+        for(;; head++) {
+            cell_t &c = cells[head & (SKT_INBOX_SIZE-1)];
+            if(c.seq.load(std::memory_order_acquire) != head+1)  return  k;
+            for(size_t i = 0; i < c.cnt; i++)  apply(c.upd[i]);
+            k += c.cnt;
+            c.seq.store(head + SKT_INBOX_SIZE, std::memory_order_release);
+        }
+    }
+};
+
+// T-1 parked workers and one inbox per thread. The caller is thread 0.
+struct SktCollector::partition_t {
+    unsigned const                  T;
+    std::unique_ptr<skt_inbox_t[]>  inbox;
+    std::vector<std::thread>        workers;
+    std::mutex                      mtx;
+    std::condition_variable         cv_start;
+    std::condition_variable         cv_done;
+    std::function<void(unsigned)> const *job;
+    uint64_t                        round;
+    unsigned                        running;
+    bool                            stop;
+
+    explicit partition_t(unsigned const T) : T(T), inbox(new skt_inbox_t[T]), job(nullptr), round(0), running(0), stop(false) {
+        for(unsigned t = 1; t < T; t++)  workers.emplace_back([this, t]() {
+            uint64_t  seen = 0;
+            std::unique_lock<std::mutex>  lock(mtx);
+            for(;;) {
+                cv_start.wait(lock, [&]() { return  stop || (round != seen); });
+                if(stop)  return;
+                seen = round;
+                lock.unlock();
+                (*job)(t);
+                lock.lock();
+                if(--running == 0)  cv_done.notify_one();
+            }
+        });
+    }
+    ~partition_t() {
+        {
+            std::lock_guard<std::mutex>  lock(mtx);
+            stop = true;
+        }
+        cv_start.notify_all();
+        for(std::thread &w : workers)  w.join();
+    }
+
+    // Runs f(t) on every thread t and returns once all are done
+    void run(std::function<void(unsigned)> const &f) {
+        {
+            std::lock_guard<std::mutex>  lock(mtx);
+            job = &f;
+            running = T-1;
+            round++;
+        }
+        cv_start.notify_all();
+        f(0);
+        std::unique_lock<std::mutex>  lock(mtx);
+        cv_done.wait(lock, [this]() { return  running == 0; });
+    }
+};
+
+void SktCollector::partition_deleter::operator()(partition_t *part) const {
+    delete  part;
+}
+
+template<typename K>
+void SktCollector::collect_partitioned(K const *data, size_t const n, unsigned const num_threads) {
+    if(sparse())  densify();
+    unsigned const  T = std::max(1u, num_threads);
+    if(T == 1) {
+        m_dispatch.of(data)(data, n, m_buckets_hll, &m_table_agms[0], &m_table_cm[0],
+                         m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm, m_pf_dist);
+        return;
+    }
+    if(!m_partition || (m_partition->T != T))  m_partition.reset(new partition_t(T));
+    partition_t &part = *m_partition;
+
+    uint8_t  *const  hll  = m_buckets_hll;
+    signed   *const  agms = &m_table_agms[0];
+    unsigned *const  cm   = &m_table_cm[0];
+
+    // Owner of table index i is (i*scale) >> 32, contiguous slices of every
+    // table. Disabled sketches route no updates.
+    uint64_t const  scale[3] = {
+        ((uint64_t)T << 32) >> m_p_hll,
+        m_r_agms? ((uint64_t)T << 32) / ((uint64_t)m_r_agms << m_p_agms) : 0,
+        m_r_cm?   ((uint64_t)T << 32) / ((uint64_t)m_r_cm << m_p_cm)     : 0
+    };
+    unsigned const  per_item = (m_p_hll? 1 : 0) + m_r_agms + m_r_cm;
+    auto const  owner = [&scale](uint64_t const  u) -> unsigned {
+        return  (unsigned)(((u & 0xFFFFFFFFu) * scale[u >> 62]) >> 32);
+    };
+    auto const  apply = [hll, agms, cm](uint64_t const  u) {
+        uint32_t const  i = (uint32_t)u;
+        unsigned const  v = (unsigned)(u >> 32) & 0xFF;
+        switch(u >> 62) {
+        case SKT_UPD_HLL  >> 62:  if(v > hll[i])  hll[i] = v;  break;
+        case SKT_UPD_AGMS >> 62:  agms[i] += 2*(signed)v - 1;  break;
+        default:                  cm[i]++;                     break;
+        }
+    };
+
+    std::atomic<unsigned>  producing(T);
+
+    std::function<void(unsigned)> const  work = [&, data, n, T](unsigned const  me) {
+        skt_inbox_t  &in = part.inbox[me];
+        // Waiting threads yield so that oversubscribed cores keep making progress
+        auto const  wait = [&]() { if(!in.drain(apply))  std::this_thread::yield(); };
+
+        size_t const  max_upd = SKT_ROUTE_TILE*per_item;
+        std::unique_ptr<uint64_t[]>  upd(new uint64_t[max_upd]);
+        std::unique_ptr<uint64_t[]>  out(new uint64_t[T*SKT_CELL_SIZE]);     // one batch staged per owner
+        std::vector<size_t>          cnt_out(T, 0);
+        // Keep consuming while an inbox is full so that no two threads wait on each other
+        auto const  flush = [&](unsigned const  d) {
+            while(!part.inbox[d].push(&out[d*SKT_CELL_SIZE], cnt_out[d]))  wait();
+            cnt_out[d] = 0;
+        };
+
+        size_t const  lo = (me*n)/T;
+        size_t const  hi = ((me+1)*n)/T;
+        for(size_t ofs = lo; ofs < hi; ofs += SKT_ROUTE_TILE) {
+            size_t const  cnt  = std::min(hi-ofs, SKT_ROUTE_TILE);
+            size_t const  nupd = cnt*per_item;
+            m_route_fn.of(data)(data+ofs, cnt, &upd[0], m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm);
+            for(size_t i = 0; i < nupd; i++) {
+                unsigned const  d = owner(upd[i]);
+                if(d == me) {
+                    apply(upd[i]);
+                    continue;
+                }
+                out[d*SKT_CELL_SIZE + cnt_out[d]++] = upd[i];
+                if(cnt_out[d] == SKT_CELL_SIZE)  flush(d);
+            }
+            in.drain(apply);
+        }
+        for(unsigned d = 0; d < T; d++)  if(cnt_out[d])  flush(d);
+        producing.fetch_sub(1, std::memory_order_release);
+        while(producing.load(std::memory_order_acquire))  wait();
+        in.drain(apply);
+    };
+    part.run(work);
+}
+template void SktCollector::collect_partitioned(uint32_t const *data, size_t const n, unsigned const num_threads);
+template void SktCollector::collect_partitioned(uint64_t const *data, size_t const n, unsigned const num_threads);
 
 #include <iostream>
 
-void SktCollector::merge0(SktCollector const& other) {
-    
+// dst[i] = max(dst[i], src[i])
+static void skt_max_u8(uint8_t *dst, uint8_t const *src, size_t const n) {
+    size_t  i = 0;
+#ifdef __AVX512BW__
+    for(; i+64 <= n; i += 64) {
+        __m512i const  a = _mm512_loadu_si512((void const*)&dst[i]);
+        __m512i const  b = _mm512_loadu_si512((void const*)&src[i]);
+        _mm512_storeu_si512((void*)&dst[i], _mm512_max_epu8(a, b));
+    }
+#endif
+#ifdef __AVX2__
+    for(; i+32 <= n; i += 32) {
+        __m256i const  a = _mm256_loadu_si256((__m256i const*)&dst[i]);
+        __m256i const  b = _mm256_loadu_si256((__m256i const*)&src[i]);
+        _mm256_storeu_si256((__m256i*)&dst[i], _mm256_max_epu8(a, b));
+    }
+#endif
+    for(; i < n; i++) {
+        if(dst[i] < src[i]) dst[i] = src[i];
+    }
+}
+
+// dst[i] += src[i], also used on the signed AGMS counters
+static void skt_add_u32(unsigned *dst, unsigned const *src, size_t const n) {
+    size_t  i = 0;
+#ifdef __AVX512F__
+    for(; i+16 <= n; i += 16) {
+        __m512i const  a = _mm512_loadu_si512((void const*)&dst[i]);
+        __m512i const  b = _mm512_loadu_si512((void const*)&src[i]);
+        _mm512_storeu_si512((void*)&dst[i], _mm512_add_epi32(a, b));
+    }
+#endif
+#ifdef __AVX2__
+    for(; i+8 <= n; i += 8) {
+        __m256i const  a = _mm256_loadu_si256((__m256i const*)&dst[i]);
+        __m256i const  b = _mm256_loadu_si256((__m256i const*)&src[i]);
+        _mm256_storeu_si256((__m256i*)&dst[i], _mm256_add_epi32(a, b));
+    }
+#endif
+    for(; i < n; i++)  dst[i] += src[i];
+}
+
+void SktCollector::check_enabled(unsigned const  sketches) const {
+    unsigned const  off = sketches & ~this->sketches();
+    if(off & SKT_HLL)   throw std::invalid_argument("HLL is disabled.");
+    if(off & SKT_AGMS)  throw std::invalid_argument("AGMS is disabled.");
+    if(off & SKT_CM)    throw std::invalid_argument("CM is disabled.");
+}
+
+void SktCollector::check_mergeable(SktCollector const& other) const {
+
     if(this->m_p_hll != other.m_p_hll)  
         throw std::invalid_argument("HLL incompatible bucket sets.");
 
@@ -98,28 +716,82 @@ void SktCollector::merge0(SktCollector const& other) {
     if(this->m_p_cm != other.m_p_cm || this->m_r_cm != other.m_r_cm)  
         throw std::invalid_argument("CM incompatible table.");
 
+    if(this->m_g_agms != other.m_g_agms || this->m_g_cm != other.m_g_cm)
+        throw std::invalid_argument("Incompatible table layouts.");
+}
+
+void SktCollector::merge0(SktCollector const& other) {
+    
+    check_mergeable(other);
+
     size_t const  M_hll  = 1<<other.m_p_hll;
     size_t const  M_agms = (1<<other.m_p_agms) * other.m_r_agms;
     size_t const  M_cm   = (1<<other.m_p_cm) * other.m_r_cm;
  
     
-    for(size_t  i = 0; i < M_hll; i++) {
-        unsigned *const  ref  = &this->m_buckets_hll[i];
-        unsigned  const  cand = other.m_buckets_hll[i];
-        if(*ref < cand) *ref = cand;
+    if(other.sparse()) {
+        if(this->m_buckets_hll)  other.sparse_fold(&this->m_buckets_hll[0]);
+        else {
+            for(uint32_t const  e : other.m_sparse_hll) {
+                if(e)  sparse_insert(e);
+                if(this->m_buckets_hll)  break;
+            }
+            // Densified on the way: the dense registers take all of other's
+            if(this->m_buckets_hll)  other.sparse_fold(&this->m_buckets_hll[0]);
+        }
     }
-
-    for(size_t  i = 0; i < M_agms; i++) {
-        signed *const  ref  = &this->m_table_agms[i];
-        signed  const  cand = other.m_table_agms[i];
-        *ref += cand;
+    else if(other.m_buckets_hll) {
+        if(!this->m_buckets_hll)  densify();
+        skt_max_u8(&this->m_buckets_hll[0], &other.m_buckets_hll[0], M_hll);
     }
 
-    for(size_t  i = 0; i < M_cm; i++) {
-        unsigned *const  ref  = &this->m_table_cm[i];
-        unsigned  const  cand = other.m_table_cm[i];
-        *ref += cand;
-    }
+    skt_add_u32(reinterpret_cast<unsigned*>(&this->m_table_agms[0]), reinterpret_cast<unsigned const*>(&other.m_table_agms[0]), M_agms);
+    skt_add_u32(&this->m_table_cm[0], &other.m_table_cm[0], M_cm);
+}
+
+// Round s merges collectors[i+s] into collectors[i] for every multiple i of
+// 2s. The merges of a round touch disjoint collectors and run in parallel on
+// threads started once for all rounds, which meet at a barrier after each.
+// The first exception of any merge is rethrown once all threads are done.
+void SktCollector::merge_tree(SktCollector *collectors, size_t const n, unsigned const num_threads) {
+    for(size_t  i = 1; i < n; i++)  collectors[0].check_mergeable(collectors[i]);
+    if(n < 2)  return;
+
+    unsigned  rounds = 0;
+    while(((size_t)1 << rounds) < n)  rounds++;
+    std::unique_ptr<std::atomic<size_t>[]>  next(new std::atomic<size_t>[rounds]);
+    for(unsigned  r = 0; r < rounds; r++)  next[r] = 0;
+
+    unsigned const  T = std::max(1u, (unsigned)std::min<size_t>(num_threads, n/2));
+    barrier_t  round_done;
+    barrier_init(&round_done, T);
+    std::mutex          error_mtx;
+    std::exception_ptr  error;
+
+    auto const  work = [&]() {
+        for(unsigned  r = 0; r < rounds; r++) {
+            size_t const  s = (size_t)1 << r;
+            size_t const  pairs = (n-s + 2*s-1) / (2*s);
+            for(size_t  k; (k = next[r]++) < pairs;) {
+                try {
+                    collectors[2*s*k].merge0(collectors[2*s*k + s]);
+                }
+                catch(...) {
+                    std::lock_guard<std::mutex>  lock(error_mtx);
+                    if(!error)  error = std::current_exception();
+                }
+            }
+            barrier_cross(&round_done);
+        }
+    };
+
+    std::vector<std::thread>  threads;
+    for(unsigned  t = 1; t < T; t++)  threads.emplace_back(work);
+    work();
+    for(std::thread &t : threads)  t.join();
+    pthread_cond_destroy(&round_done.complete);
+    pthread_mutex_destroy(&round_done.mutex);
+    if(error)  std::rethrow_exception(error);
 }
 
 void SktCollector::merge0_columns(SktCollector const& other) {
@@ -130,7 +802,7 @@ void SktCollector::merge0_columns(SktCollector const& other) {
         signed *const  ref  = &this->m_table_agms[i];
 
         for (size_t j=0; j<N; j++){
-            signed  const  cand = other.m_table_agms[i*N+j];
+            signed  const  cand = other.m_table_agms[other.agms_index(i, j)];
             *ref += cand*cand;
         }
         //std::cout<< this->m_table[i]<<std::endl;
@@ -149,47 +821,560 @@ double SktCollector::get_median() {
     return  median;
 }
 
-double SktCollector::estimate_cardinality() {
-    size_t const  M = 1<<m_p_hll;
-    double const  ALPHA = (0.7213*M)/(M+1.079);
+// Sum of a[i]*b[i] over i < cnt in 64 bits
+static int64_t skt_dot(signed const *a, signed const *b, size_t const cnt) {
+    int64_t  sum = 0;
+    size_t   i = 0;
+#ifdef __AVX2__
+    // _mm256_mul_epi32 multiplies the even 32-bit lanes into 64-bit products,
+    // the odd lanes are shifted down for a second multiply.
+    __m256i  acc = _mm256_setzero_si256();
+    for(; i+8 <= cnt; i += 8) {
+        __m256i const  va = _mm256_loadu_si256((__m256i const*)&a[i]);
+        __m256i const  vb = _mm256_loadu_si256((__m256i const*)&b[i]);
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(va, vb));
+        acc = _mm256_add_epi64(acc, _mm256_mul_epi32(_mm256_srli_epi64(va, 32), _mm256_srli_epi64(vb, 32)));
+    }
+    __m128i const  s = _mm_add_epi64(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    sum = _mm_cvtsi128_si64(s) + _mm_extract_epi64(s, 1);
+#endif
+    for(; i < cnt; i++)  sum += (int64_t)a[i] * b[i];
+    return  sum;
+}
+
+// Per-row sums of a[i]*b[i] over two AGMS tables of this collector's geometry.
+void SktCollector::agms_row_products(signed const *a, signed const *b, int64_t (&sums)[SKT_MAX_ROWS]) const {
+    size_t const  run    = size_t(1) << m_g_agms;
+    size_t const  blocks = size_t(1) << (m_p_agms - m_g_agms);
 
-    // Raw Estimate and Zero Count
-    size_t zeros    = 0;
-    double rawest   = 0.0;
-    for(unsigned  i = 0; i < M; i++) {
-        unsigned const  rank = m_buckets_hll[i];
-        if(rank == 0)   zeros++;
-        if(std::numeric_limits<double>::is_iec559) {
-            union { uint64_t  i; double  f; } d = { .i = (UINT64_C(1023)-rank)<<52 };
-            rawest += d.f;
+    std::fill(std::begin(sums), std::end(sums), 0);
+    if(run >= 8) {
+        // Row runs are long enough for vectors.
+        for(size_t  blk = 0; blk < blocks; blk++) {
+            for(unsigned  j = 0; j < m_r_agms; j++) {
+                size_t const  ofs = (blk*m_r_agms + j) << m_g_agms;
+                sums[j] += skt_dot(&a[ofs], &b[ofs], run);
+            }
         }
-        else rawest += 1.0/pow(2.0, rank);
     }
-    rawest = (ALPHA * M * M) / rawest;
+    else {
+        // Short runs: accumulate by position over a period of L = lcm(B, 8)
+        // counters, so that each vector lane stays on one block position,
+        // then fold the positions into their rows.
+        size_t const  B = m_r_agms << m_g_agms;
+        size_t const  N = blocks * B;
+        size_t  L = B;
+        while(L % 8)  L += B;
 
-    // Refine Output
-    if(rawest <= 2.5*M) {                           // Small Range Correction
-        // Linear counting
-        if(zeros)   return  M * log((double)M / (double)zeros);
+        size_t  i = 0;
+#ifdef __AVX2__
+        // acc[v..v+3] holds the even positions v, v+2, .. and acc[v+4..v+7] the odd ones.
+        alignas(32) int64_t  acc[8*SKT_MAX_ROWS] = { 0, };
+        for(; i+L <= N; i += L) {
+            for(size_t  v = 0; v < L; v += 8) {
+                __m256i const  va = _mm256_loadu_si256((__m256i const*)&a[i+v]);
+                __m256i const  vb = _mm256_loadu_si256((__m256i const*)&b[i+v]);
+                __m256i *const  pe = (__m256i*)&acc[v];
+                __m256i *const  po = (__m256i*)&acc[v+4];
+                _mm256_store_si256(pe, _mm256_add_epi64(_mm256_load_si256(pe), _mm256_mul_epi32(va, vb)));
+                _mm256_store_si256(po, _mm256_add_epi64(_mm256_load_si256(po), _mm256_mul_epi32(_mm256_srli_epi64(va, 32), _mm256_srli_epi64(vb, 32))));
+            }
+        }
+        for(size_t  v = 0; v < L; v += 8) {
+            for(size_t  m = 0; m < 4; m++) {
+                sums[((v+2*m)   % B) >> m_g_agms] += acc[v+m];
+                sums[((v+2*m+1) % B) >> m_g_agms] += acc[v+4+m];
+            }
+        }
+#endif
+        for(; i < N; i += B) {
+            for(size_t  k = 0; k < B; k++)  sums[k >> m_g_agms] += (int64_t)a[i+k] * b[i+k];
+        }
     }
-// DROP Large Range Correction - It makes things worse instead of better.
-//  else if(rawest > CONST_TWO_POWER_32/30.0) {     // Large Range Correction
-//      return (-CONST_TWO_POWER_32) * log(1.0 - (rawest / CONST_TWO_POWER_32));
-//  }
-    return  rawest;
 }
 
+double SktCollector::estimate_f2() const {
+    check_enabled(SKT_AGMS);
+    int64_t  sums[SKT_MAX_ROWS];
+    agms_row_products(&m_table_agms[0], &m_table_agms[0], sums);
+    std::sort(sums, sums+m_r_agms);
+    return  (double(sums[(m_r_agms-1)/2]) + double(sums[m_r_agms/2]))/2;
+}
+
+double SktCollector::estimate_inner_product(SktCollector const& other) const {
+    check_enabled(SKT_AGMS);
+    if(this->m_p_agms != other.m_p_agms || this->m_r_agms != other.m_r_agms)
+        throw std::invalid_argument("AGMS incompatible table.");
+
+    if(this->m_g_agms != other.m_g_agms)
+        throw std::invalid_argument("Incompatible table layouts.");
+
+    int64_t  sums[SKT_MAX_ROWS];
+    agms_row_products(&m_table_agms[0], &other.m_table_agms[0], sums);
+    std::sort(sums, sums+m_r_agms);
+    return  (double(sums[(m_r_agms-1)/2]) + double(sums[m_r_agms/2]))/2;
+}
+
+void SktCollector::hll_histogram(uint32_t (&hist)[256]) const {
+    size_t const  M = size_t(1) << m_p_hll;
+    uint8_t const *const  reg = &m_buckets_hll[0];
+
+    std::fill(std::begin(hist), std::end(hist), 0);
+    size_t  i = 0;
+#ifdef __AVX2__
+    // Chunks of at most 255 vectors (8 KB) stay in L1 and cannot wrap the
+    // per-lane byte counters. Each chunk is scanned once per rank present.
+    size_t const  CHUNK = 255*32;
+    while(i+32 <= M) {
+        size_t const  end = i + std::min(CHUNK, (M-i) & ~size_t(31));
+
+        __m256i  lo = _mm256_set1_epi8(-1);
+        __m256i  hi = _mm256_setzero_si256();
+        for(size_t j = i; j < end; j += 32) {
+            __m256i const  v = _mm256_loadu_si256((__m256i const*)&reg[j]);
+            lo = _mm256_min_epu8(lo, v);
+            hi = _mm256_max_epu8(hi, v);
+        }
+        alignas(32) uint8_t  lo_b[32], hi_b[32];
+        _mm256_store_si256((__m256i*)lo_b, lo);
+        _mm256_store_si256((__m256i*)hi_b, hi);
+        unsigned const  rank_lo = *std::min_element(lo_b, lo_b+32);
+        unsigned const  rank_hi = *std::max_element(hi_b, hi_b+32);
+
+        for(unsigned  r = rank_lo; r <= rank_hi; r++) {
+            __m256i const  rv  = _mm256_set1_epi8((char)r);
+            __m256i        cnt = _mm256_setzero_si256();
+            for(size_t j = i; j < end; j += 32) {
+                cnt = _mm256_sub_epi8(cnt, _mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i const*)&reg[j]), rv));
+            }
+            __m256i const  sum = _mm256_sad_epu8(cnt, _mm256_setzero_si256());
+            hist[r] += _mm256_extract_epi64(sum, 0) + _mm256_extract_epi64(sum, 1) + _mm256_extract_epi64(sum, 2) + _mm256_extract_epi64(sum, 3);
+        }
+        i = end;
+    }
+#endif
+    for(; i < M; i++)  hist[reg[i]]++;
+}
+
+// sigma(x) = x + sum_k x^(2^k) 2^(k-1)
+static double ertl_sigma(double  x) {
+    if(x == 1.0)  return  std::numeric_limits<double>::infinity();
+    double  y = 1.0;
+    double  z = x;
+    double  z_old;
+    do {
+        x *= x;
+        z_old = z;
+        z += x * y;
+        y += y;
+    } while(z != z_old);
+    return  z;
+}
+
+// tau(x) = (1 - x - sum_k (1 - x^(2^-k))^2 2^-k) / 3
+static double ertl_tau(double  x) {
+    if(x == 0.0 || x == 1.0)  return  0.0;
+    double  y = 1.0;
+    double  z = 1.0 - x;
+    double  z_old;
+    do {
+        x = sqrt(x);
+        z_old = z;
+        y *= 0.5;
+        z -= (1.0 - x) * (1.0 - x) * y;
+    } while(z != z_old);
+    return  z / 3.0;
+}
+
+// Improved estimator by Ertl (arXiv:1702.01284): no bias tables and no
+// switch to linear counting, accurate from a few keys up to 2^(p+q).
+double skt_hll_estimate(uint32_t const (&hist)[256], unsigned const p_val, unsigned const q_val) {
+    double const  M = (double)(UINT64_C(1) << p_val);
+
+    double  z = M * ertl_tau(1.0 - hist[q_val+1]/M);
+    for(unsigned  k = q_val; k > 0; k--)  z = 0.5 * (z + hist[k]);
+    z += M * ertl_sigma(hist[0]/M);
+
+    return  M * M / (2.0 * log(2.0) * z);
+}
+
+double SktCollector::estimate_cardinality() {
+    check_enabled(SKT_HLL);
+    if(sparse()) {
+        // Linear counting over the sparse registers
+        double const  M_sparse = (double)(UINT64_C(1) << SKT_HLL_SPARSE_P);
+        return  M_sparse * log(M_sparse / (M_sparse - m_sparse_cnt));
+    }
+
+    uint32_t  hist[256];
+    hll_histogram(hist);
+    return  skt_hll_estimate(hist, m_p_hll, m_q_hll);
+}
+
+// Zeroes the whole slab in one pass. Slabs too big to stay cached for the
+// next collection are cleared with streaming stores that do not pull the dead
+// table contents into the caches first.
+static size_t constexpr  SKT_CLEAN_STREAM = size_t(8) << 20;
+
 void SktCollector::clean(){
-    size_t const M_hll  = 1<<this->m_p_hll;
-    size_t const M_agms = (1<<this->m_p_agms) * this->m_r_agms;
-    size_t const M_cm   = (1<<this->m_p_cm) * this->m_r_cm;
+    if(sparse()) {
+        std::fill(m_sparse_hll.begin(), m_sparse_hll.end(), 0);
+        m_sparse_cnt = 0;
+    }
+    if(m_slab_hll)  memset(&m_slab_hll[0], 0, size_t(1) << m_p_hll);
+    if(!m_slab)  return;
+
+    uint8_t *const  slab = &m_slab[0];
+    size_t   const  size = m_slab_size;
+    size_t  i = 0;
+#ifdef __AVX2__
+    if(size >= SKT_CLEAN_STREAM) {
+        __m256i const  zero = _mm256_setzero_si256();
+        for(; i+32 <= size; i += 32)  _mm256_stream_si256((__m256i*)&slab[i], zero);
+        _mm_sfence();
+    }
+#endif
+    memset(&slab[i], 0, size-i);
+}
+
+//---------------------------------------------------------------------------
+// Sliding Windows
+#ifdef INCLUDE_AVX_HASHES
+#define WINDOW_AVX \
+    SktWindow::window_t { skt_collect_window_ptr<hash_e::MURMUR3_32AVX>, skt_collect_window_ptr<hash_e::MURMUR3_32AVX>, skt_collect_window_ptr<hash_e::MURMUR3_32AVX> }, \
+    SktWindow::window_t { skt_collect_window_ptr<hash_e::MURMUR3_64AVX>, skt_collect_window_ptr<hash_e::MURMUR3_64AVX>, skt_collect_window_ptr<hash_e::MURMUR3_64AVX> },
+#else
+#define WINDOW_AVX
+#endif
+std::array<SktWindow::window_t, (unsigned)hash_e::end> const  SktWindow::WINDOW {
+    SktWindow::window_t { skt_collect_window_ptr<hash_e::IDENT>, skt_collect_window_ptr<hash_e::IDENT>, nullptr },
+    SktWindow::window_t { skt_collect_window_ptr<hash_e::SIP>, skt_collect_window_ptr<hash_e::SIP>, skt_collect_window_ptr<hash_e::SIP> },
+    SktWindow::window_t { skt_collect_window_ptr<hash_e::MURMUR3_32>, skt_collect_window_ptr<hash_e::MURMUR3_32>, skt_collect_window_ptr<hash_e::MURMUR3_32> },
+    SktWindow::window_t { skt_collect_window_ptr<hash_e::MURMUR3_64>, skt_collect_window_ptr<hash_e::MURMUR3_64>, skt_collect_window_ptr<hash_e::MURMUR3_64> },
+    SktWindow::window_t { skt_collect_window_ptr<hash_e::MURMUR3_128>, skt_collect_window_ptr<hash_e::MURMUR3_128>, skt_collect_window_ptr<hash_e::MURMUR3_128> },
+    WINDOW_AVX
+};
+#undef WINDOW_AVX
 
-    for(unsigned i=0; i<M_hll; i++)
-        this->m_buckets_hll[i] = 0;
+// Ranks reach q+1, which bounds the strictly falling LFPM lists. Their slots
+// are left uninitialized so that only the pages of used lists get touched.
+SktWindow::SktWindow(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, unsigned const span, layout_e const layout)
+ : m_hash(hash), m_layout(layout), m_span(span), m_tick(0),
+   m_p_hll(hp_val), m_lfpm_cap(SktCollector::hash_bits(hash) - hp_val + 1),
+   m_lfpm(new uint64_t[(size_t)m_lfpm_cap << hp_val]), m_lfpm_len(new uint8_t[size_t(1) << hp_val]()), m_lfpm_now(new uint8_t[size_t(1) << hp_val]()),
+   m_window_fn(WINDOW.at((unsigned)hash)) {
+    if(span == 0)  throw std::invalid_argument("Empty window.");
+    if(hp_val == 0)  throw std::invalid_argument("A window needs its HLL.");
+    // The HLL lives in the LFPM lists, the ring only holds AGMS and CM
+    if(!ar_val && !cr_val)  return;
+    m_ring.reserve(span);
+    for(unsigned  i = 0; i < span; i++)  m_ring.emplace_back(hp_val, ar_val, ap_val, cr_val, cp_val, hash, collect_e::BLOCKED, layout, false, pages_e::THP, SKT_AGMS | SKT_CM);
+}
+
+// Clears at most one table set per tick passed, however many items it held.
+void SktWindow::advance(uint64_t const  tick) {
+    if(tick <= m_tick)  return;
+    uint64_t const  steps = std::min<uint64_t>(tick - m_tick, m_span);
+    for(uint64_t  s = 1; !m_ring.empty() && (s <= steps); s++)  m_ring[(m_tick + s) % m_span].clean();
+    memset(&m_lfpm_now[0], 0, size_t(1) << m_p_hll);
+    m_tick = tick;
+}
+
+SktCollector SktWindow::snapshot(unsigned const  span) const {
+    if((span == 0) || (span > m_span))  throw std::invalid_argument("Window span out of bounds.");
+
+    SktCollector  res = m_ring.empty()? SktCollector(m_p_hll, 0, 1, 0, 1, m_hash, collect_e::BLOCKED, m_layout)
+                                      : SktCollector(m_p_hll, m_ring[0].m_r_agms, m_ring[0].m_p_agms, m_ring[0].m_r_cm, m_ring[0].m_p_cm, m_hash, collect_e::BLOCKED, m_layout);
+    uint64_t const  first = (m_tick+1 >= span)? m_tick+1 - span : 0;
+    for(uint64_t  t = first; !m_ring.empty() && (t <= m_tick); t++) {
+        SktCollector const &sub = m_ring[t % m_span];
+        skt_add_u32(reinterpret_cast<unsigned*>(&res.m_table_agms[0]), reinterpret_cast<unsigned const*>(&sub.m_table_agms[0]), (size_t)sub.m_r_agms << sub.m_p_agms);
+        skt_add_u32(&res.m_table_cm[0], &sub.m_table_cm[0], (size_t)sub.m_r_cm << sub.m_p_cm);
+    }
+
+    // The oldest entry still inside the window holds the register's maximum
+    uint64_t const  floor = first << 8;
+    size_t   const  M = size_t(1) << m_p_hll;
+    for(size_t  i = 0; i < M; i++) {
+        uint64_t const *const  list = &m_lfpm[i*m_lfpm_cap];
+        unsigned const  len = m_lfpm_len[i];
+        unsigned  k = 0;
+        while((k < len) && (list[k] < floor))  k++;
+        res.m_buckets_hll[i] = (k < len)? (uint8_t)list[k] : 0;
+    }
+    return  res;
+}
+
+//---------------------------------------------------------------------------
+// Tumbling Windows
+SktStore::SktStore(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, std::vector<unsigned> const &fanout, unsigned const retain, collect_e const mode, layout_e const layout)
+ : m_hp(hp_val), m_ar(ar_val), m_ap(ap_val), m_cr(cr_val), m_cp(cp_val), m_hash(hash), m_mode(mode), m_layout(layout), m_retain(retain),
+   m_fanout(fanout), m_len(1, 1), m_first(fanout.size()+1, 0), m_levels(fanout.size()+1), m_tick(0) {
+    if(retain == 0)  throw std::invalid_argument("Nothing retained.");
+    for(unsigned const  f : fanout) {
+        if(f < 2)  throw std::invalid_argument("Fanout below 2.");
+        m_len.push_back(m_len.back() * f);
+    }
+}
+
+SktCollector SktStore::take() {
+    if(m_pool.empty())  return  SktCollector(m_hp, m_ar, m_ap, m_cr, m_cp, m_hash, m_mode, m_layout);
+    SktCollector  c(std::move(m_pool.back()));
+    m_pool.pop_back();
+    return  c;
+}
 
-    for(unsigned i=0; i<M_agms; i++)
-        this->m_table_agms[i] = 0;
+void SktStore::release(SktCollector &&c) {
+    c.clean();
+    m_pool.push_back(std::move(c));
+}
+
+SktCollector& SktStore::current() {
+    auto  it = m_levels[0].find(m_tick);
+    if(it == m_levels[0].end())  it = m_levels[0].emplace(m_tick, take()).first;
+    return  it->second;
+}
+
+// Drops the intervals of a level that start before tick
+void SktStore::evict(unsigned const  level, uint64_t const  tick) {
+    if(tick <= m_first[level])  return;
+    std::map<uint64_t, SktCollector> &lvl = m_levels[level];
+    auto const  end = lvl.lower_bound(tick / m_len[level]);
+    for(auto  it = lvl.begin(); it != end; it = lvl.erase(it))  release(std::move(it->second));
+    m_first[level] = tick;
+}
+
+void SktStore::advance(uint64_t const  tick) {
+    if(tick <= m_tick)  return;
+
+    for(unsigned  k = 0; k < m_fanout.size(); k++) {
+        uint64_t const  done = m_tick / m_len[k+1];
+        uint64_t const  next = tick   / m_len[k+1];
+        if(done == next)  break;
+
+        // The parent interval done is complete, all its children are final
+        std::map<uint64_t, SktCollector> &lvl = m_levels[k];
+        auto        it  = lvl.lower_bound(done * m_fanout[k]);
+        auto const  end = lvl.lower_bound((done+1) * m_fanout[k]);
+        if(it != end) {
+            SktCollector  parent = take();
+            for(; it != end; ++it)  parent.merge(it->second);
+            m_levels[k+1].emplace(done, std::move(parent));
+        }
+        evict(k, (next-1) * m_len[k+1]);
+    }
+
+    unsigned const  top = m_fanout.size();
+    uint64_t const  last = tick / m_len[top];
+    if(last > m_retain)  evict(top, (last - m_retain) * m_len[top]);
+    m_tick = tick;
+}
+
+// Merges the intervals of level that make up [from, to) into res, descending
+// to the finer levels for intervals that are cut or not rolled up yet.
+void SktStore::cover(unsigned const  level, uint64_t const  from, uint64_t const  to, SktCollector &res) const {
+    uint64_t const  len = m_len[level];
+    std::map<uint64_t, SktCollector> const &lvl = m_levels[level];
+    for(uint64_t  idx = from / len; idx*len < to; idx++) {
+        uint64_t const  lo = idx*len;
+        uint64_t const  hi = lo + len;
+        auto const  it = lvl.find(idx);
+        bool const  whole = (from <= lo) && (hi <= to);
+        if((level > 0) && !(whole && (it != lvl.end())) && (lo >= m_first[level-1])) {
+            cover(level-1, std::max(from, lo), std::min(to, hi), res);
+        }
+        else if(it != lvl.end())  res.merge(it->second);
+    }
+}
+
+SktCollector SktStore::query(uint64_t const  from, uint64_t const  to) {
+    if(from >= to)  throw std::invalid_argument("Empty time range.");
+
+    SktCollector  res = take();
+    unsigned const  top = m_fanout.size();
+    uint64_t const  lo = std::max(from, m_first[top]);
+    uint64_t const  hi = std::min(to, m_tick+1);
+    if(lo < hi)  cover(top, lo, hi, res);
+    return  res;
+}
+
+//---------------------------------------------------------------------------
+// Grouped Collection
+template<typename K>
+SktGroups<K>::SktGroups(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, unsigned const small, collect_e const mode, layout_e const layout)
+ : m_hp(hp_val), m_ar(ar_val), m_ap(ap_val), m_cr(cr_val), m_cp(cp_val), m_hash(hash), m_mode(mode), m_layout(layout), m_small(small),
+   m_dir(1024, 0) {
+    if(small == 0)  throw std::invalid_argument("Empty group chunks.");
+    m_free_chunks.resize(chunk_class(small)+1);
+}
+
+// Classes start at 4 keys, the last one holds m_small
+template<typename K>
+unsigned SktGroups<K>::chunk_class(uint32_t const  cnt) const {
+    unsigned  cls = 2;
+    while(chunk_cap(cls) < cnt)  cls++;
+    return  cls;
+}
+
+template<typename K>
+uint32_t SktGroups<K>::chunk_alloc(unsigned const  cls) {
+    std::vector<uint32_t> &free = m_free_chunks[cls];
+    if(free.empty()) {
+        uint32_t const  chunk = m_arena.size();
+        m_arena.resize(m_arena.size() + chunk_cap(cls));
+        return  chunk;
+    }
+    uint32_t const  chunk = free.back();
+    free.pop_back();
+    return  chunk;
+}
+
+template<typename K>
+uint32_t SktGroups<K>::find(uint32_t const  id) const {
+    size_t const  mask = m_dir.size()-1;
+    for(size_t  i = (id * UINT32_C(0x9E3779B1)) & mask;; i = (i+1) & mask) {
+        uint32_t const  e = m_dir[i];
+        if(e == 0)  return  NONE;
+        if(m_groups[e-1].id == id)  return  e-1;
+    }
+}
+
+// Grows the directory at half load
+template<typename K>
+uint32_t SktGroups<K>::insert(uint32_t const  id) {
+    size_t  mask = m_dir.size()-1;
+    size_t  i = (id * UINT32_C(0x9E3779B1)) & mask;
+    for(; m_dir[i]; i = (i+1) & mask) {
+        if(m_groups[m_dir[i]-1].id == id)  return  m_dir[i]-1;
+    }
+
+    m_groups.push_back(group_t { id, 0, NONE, NONE });
+    m_count.push_back(0);
+    m_dir[i] = m_groups.size();
+
+    if(2*m_groups.size() > m_dir.size()) {
+        std::vector<uint32_t>(2*m_dir.size(), 0).swap(m_dir);
+        mask = m_dir.size()-1;
+        for(uint32_t  g = 0; g < m_groups.size(); g++) {
+            size_t  j = (m_groups[g].id * UINT32_C(0x9E3779B1)) & mask;
+            while(m_dir[j])  j = (j+1) & mask;
+            m_dir[j] = g+1;
+        }
+    }
+    return  m_groups.size()-1;
+}
+
+template<typename K>
+void SktGroups<K>::apply(group_t &grp, K const *keys, size_t const  cnt) {
+    if(grp.coll == NONE) {
+        uint32_t const  need = grp.cnt + cnt;
+        if(need <= m_small) {
+            // Move to a chunk of the next class once this one is full
+            unsigned const  cls = chunk_class(need);
+            if(!grp.cnt || (cls != chunk_class(grp.cnt))) {
+                uint32_t const  chunk = chunk_alloc(cls);
+                if(grp.cnt) {
+                    std::copy(&m_arena[grp.chunk], &m_arena[grp.chunk] + grp.cnt, &m_arena[chunk]);
+                    m_free_chunks[chunk_class(grp.cnt)].push_back(grp.chunk);
+                }
+                grp.chunk = chunk;
+            }
+            std::copy(keys, keys+cnt, &m_arena[grp.chunk] + grp.cnt);
+            grp.cnt = need;
+            return;
+        }
+
+        // Promote: replay the chunk into a fresh collector and recycle the chunk
+        grp.coll = m_colls.size();
+        m_colls.emplace_back(m_hp, m_ar, m_ap, m_cr, m_cp, m_hash, m_mode, m_layout, m_mode != collect_e::ATOMIC);
+        if(grp.cnt) {
+            m_colls.back().collect(&m_arena[grp.chunk], grp.cnt);
+            m_free_chunks[chunk_class(grp.cnt)].push_back(grp.chunk);
+        }
+        grp.chunk = NONE;
+        grp.cnt   = 0;
+    }
+    m_colls[grp.coll].collect(keys, cnt);
+}
+
+// Counting sort by group: m_count first counts, then holds the run ends.
+template<typename K>
+void SktGroups<K>::collect(uint32_t const *groups, K const *keys, size_t const  n) {
+    m_gidx.resize(n);
+    m_sorted.resize(n);
+    for(size_t  i = 0; i < n; i++) {
+        uint32_t const  g = insert(groups[i]);
+        m_gidx[i] = g;
+        if(m_count[g]++ == 0)  m_touched.push_back(g);
+    }
+
+    uint32_t  pos = 0;
+    for(uint32_t const  g : m_touched) {
+        uint32_t const  c = m_count[g];
+        m_count[g] = pos;
+        pos += c;
+    }
+    for(size_t  i = 0; i < n; i++)  m_sorted[m_count[m_gidx[i]]++] = keys[i];
+
+    uint32_t  start = 0;
+    for(uint32_t const  g : m_touched) {
+        uint32_t const  end = m_count[g];
+        m_count[g] = 0;
+        apply(m_groups[g], &m_sorted[start], end - start);
+        start = end;
+    }
+    m_touched.clear();
+}
+
+template<typename K>
+std::vector<K> SktGroups<K>::small_keys(group_t const &grp) const {
+    if(!grp.cnt)  return  std::vector<K>();
+    K const *const  chunk = &m_arena[grp.chunk];
+    std::vector<K>  keys(chunk, chunk + grp.cnt);
+    std::sort(keys.begin(), keys.end());
+    return  keys;
+}
+
+template<typename K>
+double SktGroups<K>::estimate_cardinality(uint32_t const  group) {
+    uint32_t const  g = find(group);
+    if(g == NONE)  return  0.0;
+    if(m_groups[g].coll != NONE)  return  m_colls[m_groups[g].coll].estimate_cardinality();
+    std::vector<K>  keys = small_keys(m_groups[g]);
+    return  std::unique(keys.begin(), keys.end()) - keys.begin();
+}
+
+template<typename K>
+double SktGroups<K>::estimate_f2(uint32_t const  group) const {
+    uint32_t const  g = find(group);
+    if(g == NONE)  return  0.0;
+    if(m_groups[g].coll != NONE)  return  m_colls[m_groups[g].coll].estimate_f2();
+    std::vector<K> const  keys = small_keys(m_groups[g]);
+    double  f2 = 0.0;
+    for(size_t  i = 0, j; i < keys.size(); i = j) {
+        for(j = i+1; (j < keys.size()) && (keys[j] == keys[i]); j++);
+        f2 += double(j-i) * double(j-i);
+    }
+    return  f2;
+}
+
+template<typename K>
+void SktGroups<K>::query_frequency(uint32_t const  group, K const *keys, size_t const  n, unsigned *cm_out) const {
+    uint32_t const  g = find(group);
+    if(g == NONE) {
+        std::fill(cm_out, cm_out+n, 0);
+        return;
+    }
+    if(m_groups[g].coll != NONE) {
+        m_colls[m_groups[g].coll].query_frequency(keys, n, cm_out);
+        return;
+    }
+    std::vector<K> const  held = small_keys(m_groups[g]);
+    for(size_t  i = 0; i < n; i++) {
+        auto const  run = std::equal_range(held.begin(), held.end(), keys[i]);
+        cm_out[i] = run.second - run.first;
+    }
+}
 
-    for(unsigned i=0; i<M_cm; i++)
-        this->m_table_cm[i] = 0;
-}
\ No newline at end of file
+template class SktGroups<uint32_t>;
+template class SktGroups<uint64_t>;
@@ -30,6 +30,10 @@
 #include <cstdint>
 #include <memory>
 #include <functional>
+#include <array>
+#include <vector>
+#include <map>
+#include <stdexcept>
 
 #include "skt.hpp"
 
@@ -40,51 +44,396 @@ template<>           char const *name_of<hash_e>(hash_e  val);
 template<typename T> T      value_of(char const *name);
 template<>           hash_e value_of<hash_e>(char const *name);
 
-// SKT Collector Backends
+// Collection Loop Strategies
+enum class collect_e : unsigned {
+    DIRECT,     // hash and update all sketches item by item
+    BLOCKED,    // hash a tile of items first, then update each sketch over the tile
+    PREFETCH,   // hash ahead and prefetch all table slots of an item before its update
+    RADIX,      // partition the updates of rows larger than L2 by table slice, then apply slice by slice
+    CONSERVATIVE, // as BLOCKED, but CM only raises the rows holding the item's minimum count
+    ATOMIC,     // as BLOCKED, but with atomic table updates so that threads can share one collector
+    PARTITIONED, // as BLOCKED within a thread, collect_partitioned() gives each thread a table slice to own
+    end
+};
+template<>           char const *name_of<collect_e>(collect_e  val);
+template<>           collect_e   value_of<collect_e>(char const *name);
+
+// AGMS and CM Table Layouts
+enum class layout_e : unsigned {
+    ROWS,       // row-major: each row is a contiguous 2^p table
+    LINES,      // row-interleaved: the slots of all rows hit by an item share one or two cache lines
+    end
+};
+template<>           char const *name_of<layout_e>(layout_e  val);
+template<>           layout_e    value_of<layout_e>(char const *name);
+
+// Backing Pages of the Sketch Tables
+enum class pages_e : unsigned {
+    SMALL,      // regular pages
+    THP,        // transparent huge pages for slabs of SKT_HUGE_PAGE and beyond
+    HUGETLB,    // explicit huge pages from the hugetlbfs pool, THP if it runs dry
+    end
+};
+template<>           char const *name_of<pages_e>(pages_e  val);
+template<>           pages_e     value_of<pages_e>(char const *name);
+
+size_t constexpr  SKT_HUGE_PAGE = size_t(2) << 20;
+
+// SKT Collector Backends, for 32-bit and 64-bit keys
+typedef void (*skt_collect_fn)(uint32_t const*, size_t, uint8_t*, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+typedef void (*skt_collect64_fn)(uint64_t const*, size_t, uint8_t*, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+
+// Sketches of a collector, or-ed into a mask. A sketch left out of the mask,
+// like one of zero size (hp_val, ar_val or cr_val 0), gets no table memory
+// and no update loop.
+unsigned constexpr  SKT_HLL  = 1;
+unsigned constexpr  SKT_AGMS = 2;
+unsigned constexpr  SKT_CM   = 4;
+unsigned constexpr  SKT_ALL  = SKT_HLL | SKT_AGMS | SKT_CM;
+
+// Upper bound on AGMS and CM rows, lets estimators keep per-row state on the stack
+unsigned constexpr  SKT_MAX_ROWS = 64;
+
+// Default distance in items at which the PREFETCH backends run ahead
+unsigned constexpr  SKT_PF_DIST = 16;
+
+// Variable-length keys in an arena: key i is bytes[offs[i] .. offs[i+1]), so
+// n keys take n+1 offsets. Adding k skips the first k keys.
+struct skt_strings_t {
+    uint8_t  const *bytes;
+    uint64_t const *offs;
+
+    skt_strings_t operator+(size_t const  k) const { return  skt_strings_t { bytes, offs+k }; }
+};
+typedef void (*skt_collect_str_fn)(skt_strings_t, size_t, uint8_t*, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+
+template<hash_e HASH, collect_e MODE>
+void skt_collect_ptr(uint32_t const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist);
+template<hash_e HASH, collect_e MODE>
+void skt_collect_ptr(uint64_t const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist);
+// Not available for IDENT
+template<hash_e HASH, collect_e MODE>
+void skt_collect_str_ptr(skt_strings_t const keys, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist);
+
+// Weighted collection: item i adds weights[i] to its CM counters and signed
+// weights[i] to its AGMS counters, only positive weights raise HLL registers.
+// CONSERVATIVE raises rows to their minimum plus the weight and throws
+// std::invalid_argument on negative weights, ATOMIC updates atomically, all
+// other modes share one blocked loop.
+typedef void (*skt_weighted_fn)(uint32_t const*, int32_t const*, size_t, uint8_t*, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+typedef void (*skt_weighted64_fn)(uint64_t const*, int32_t const*, size_t, uint8_t*, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+typedef void (*skt_weighted_str_fn)(skt_strings_t, int32_t const*, size_t, uint8_t*, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+
+template<hash_e HASH, collect_e MODE>
+void skt_collect_weighted_ptr(uint32_t const *data, int32_t const *weights, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val);
+template<hash_e HASH, collect_e MODE>
+void skt_collect_weighted_ptr(uint64_t const *data, int32_t const *weights, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val);
+// Not available for IDENT
+template<hash_e HASH, collect_e MODE>
+void skt_collect_weighted_ptr(skt_strings_t const keys, int32_t const *weights, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val);
+
+// Sliding-window collection into LFPM registers stamped with tick and the
+// AGMS and CM tables of one sub-window, see SktWindow
+typedef void (*skt_window_fn)(uint32_t const*, size_t, uint64_t*, uint8_t*, uint8_t*, unsigned, uint64_t, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+typedef void (*skt_window64_fn)(uint64_t const*, size_t, uint64_t*, uint8_t*, uint8_t*, unsigned, uint64_t, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+typedef void (*skt_window_str_fn)(skt_strings_t, size_t, uint64_t*, uint8_t*, uint8_t*, unsigned, uint64_t, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+
+template<hash_e HASH>
+void skt_collect_window_ptr(uint32_t const *data, size_t const num_items, uint64_t *lfpm, uint8_t *lfpm_len, uint8_t *lfpm_now, unsigned const lfpm_cap, uint64_t const tick, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val);
 template<hash_e HASH>
-void skt_collect_ptr(uint32_t const *data, size_t const num_items, unsigned *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val);
+void skt_collect_window_ptr(uint64_t const *data, size_t const num_items, uint64_t *lfpm, uint8_t *lfpm_len, uint8_t *lfpm_now, unsigned const lfpm_cap, uint64_t const tick, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val);
+// Not available for IDENT
+template<hash_e HASH>
+void skt_collect_window_ptr(skt_strings_t const keys, size_t const num_items, uint64_t *lfpm, uint8_t *lfpm_len, uint8_t *lfpm_now, unsigned const lfpm_cap, uint64_t const tick, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val);
+
+// Hash word of each hash function
+template<hash_e HASH> struct skt_word { typedef uint64_t  type; };
+template<> struct skt_word<hash_e::IDENT>         { typedef uint32_t  type; };
+template<> struct skt_word<hash_e::MURMUR3_32>    { typedef uint32_t  type; };
+template<> struct skt_word<hash_e::MURMUR3_128>   { typedef uint128_t type; };
+#ifdef INCLUDE_AVX_HASHES
+template<> struct skt_word<hash_e::MURMUR3_32AVX> { typedef uint32_t  type; };
+#endif
+
+// Hash values of num_items keys, as the collectors compute them
+template<hash_e HASH>
+void skt_hash_ptr(uint32_t const *data, size_t const num_items, typename skt_word<HASH>::type *hashv);
+template<hash_e HASH>
+void skt_hash_ptr(uint64_t const *data, size_t const num_items, typename skt_word<HASH>::type *hashv);
+// Not available for IDENT
+template<hash_e HASH>
+void skt_hash_ptr(skt_strings_t const keys, size_t const num_items, typename skt_word<HASH>::type *hashv);
+
+// HLL estimate (Ertl) of 2^p registers with q rank bits from the number of registers holding each rank
+double skt_hll_estimate(uint32_t const (&hist)[256], unsigned const p_val, unsigned const q_val);
+
+// Sparse HLL: index precision of the sparse registers and the encoders that
+// turn items into idx<<7 | rank entries at this precision
+unsigned constexpr  SKT_HLL_SPARSE_P = 25;
+typedef void (*skt_sparse_fn)(uint32_t const*, size_t, uint32_t*);
+typedef void (*skt_sparse64_fn)(uint64_t const*, size_t, uint32_t*);
+typedef void (*skt_sparse_str_fn)(skt_strings_t, size_t, uint32_t*);
+
+template<hash_e HASH>
+void skt_hll_sparse_ptr(uint32_t const *data, size_t const num_items, uint32_t *entries);
+template<hash_e HASH>
+void skt_hll_sparse_ptr(uint64_t const *data, size_t const num_items, uint32_t *entries);
+template<hash_e HASH>
+void skt_hll_sparse_str_ptr(skt_strings_t const keys, size_t const num_items, uint32_t *entries);
+
+// Point frequency queries: CM minimum and AGMS median per key, either output may be null
+typedef void (*skt_query_fn)(uint32_t const*, size_t, signed const*, unsigned const*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, double*, unsigned*);
+typedef void (*skt_query64_fn)(uint64_t const*, size_t, signed const*, unsigned const*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, double*, unsigned*);
+typedef void (*skt_query_str_fn)(skt_strings_t, size_t, signed const*, unsigned const*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, double*, unsigned*);
+
+template<hash_e HASH>
+void skt_query_ptr(uint32_t const *keys, size_t const num_keys, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out);
+template<hash_e HASH>
+void skt_query_ptr(uint64_t const *keys, size_t const num_keys, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out);
+template<hash_e HASH>
+void skt_query_str_ptr(skt_strings_t const keys, size_t const num_keys, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out);
+
+// Partitioned collection: routers turn items into (1+ar+cr) table updates per
+// item, encoded as kind<<62 | value<<32 | table index. Per tile of SKT_TILE
+// items they emit the HLL updates first (none for hp 0), then AGMS and CM row
+// by row.
+// HLL values are the register rank, AGMS values the sign bit (1: +1, 0: -1).
+uint64_t constexpr  SKT_UPD_HLL  = UINT64_C(0) << 62;
+uint64_t constexpr  SKT_UPD_AGMS = UINT64_C(1) << 62;
+uint64_t constexpr  SKT_UPD_CM   = UINT64_C(2) << 62;
+typedef void (*skt_route_fn)(uint32_t const*, size_t, uint64_t*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+typedef void (*skt_route64_fn)(uint64_t const*, size_t, uint64_t*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned);
+
+template<hash_e HASH>
+void skt_route_ptr(uint32_t const *data, size_t const num_items, uint64_t *updates, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val);
+template<hash_e HASH>
+void skt_route_ptr(uint64_t const *data, size_t const num_items, uint64_t *updates, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val);
+
+// Backends specialized for a fixed sketch geometry, nullptr if none is registered
+skt_collect_fn skt_collect_fixed_ptr(hash_e const hash, collect_e const mode, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val);
+skt_collect64_fn skt_collect_fixed64_ptr(hash_e const hash, collect_e const mode, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val);
 
 class SktCollector {
+    friend class SktWindow;
 
+    // Backends for 32-bit, 64-bit and string keys (null for IDENT)
     struct dispatch_t {
-        void (*f_ptr)(uint32_t const*, size_t, unsigned*, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned);
+        skt_collect_fn      f_ptr;
+        skt_collect64_fn    f_ptr64;
+        skt_collect_str_fn  f_str;
+        skt_collect_fn      of(uint32_t const*) const { return  f_ptr; }
+        skt_collect64_fn    of(uint64_t const*) const { return  f_ptr64; }
+        skt_collect_str_fn  of(skt_strings_t)   const { return  f_str; }
+    };
+    struct sparse_t {
+        skt_sparse_fn       f_ptr;
+        skt_sparse64_fn     f_ptr64;
+        skt_sparse_str_fn   f_str;
+        skt_sparse_fn       of(uint32_t const*) const { return  f_ptr; }
+        skt_sparse64_fn     of(uint64_t const*) const { return  f_ptr64; }
+        skt_sparse_str_fn   of(skt_strings_t)   const { return  f_str; }
+    };
+    struct query_t {
+        skt_query_fn        f_ptr;
+        skt_query64_fn      f_ptr64;
+        skt_query_str_fn    f_str;
+        skt_query_fn        of(uint32_t const*) const { return  f_ptr; }
+        skt_query64_fn      of(uint64_t const*) const { return  f_ptr64; }
+        skt_query_str_fn    of(skt_strings_t)   const { return  f_str; }
+    };
+    struct weighted_t {
+        skt_weighted_fn     f_ptr;
+        skt_weighted64_fn   f_ptr64;
+        skt_weighted_str_fn f_str;
+        skt_weighted_fn     of(uint32_t const*) const { return  f_ptr; }
+        skt_weighted64_fn   of(uint64_t const*) const { return  f_ptr64; }
+        skt_weighted_str_fn of(skt_strings_t)   const { return  f_str; }
     };
-    static std::array<dispatch_t, (unsigned)hash_e::end> const  DISPATCH;
+    struct route_t {
+        skt_route_fn        f_ptr;
+        skt_route64_fn      f_ptr64;
+        skt_route_fn        of(uint32_t const*) const { return  f_ptr; }
+        skt_route64_fn      of(uint64_t const*) const { return  f_ptr64; }
+    };
+    // Threads and inboxes of collect_partitioned(), kept across calls
+    struct partition_t;
+    struct partition_deleter {
+        void operator()(partition_t *part) const;
+    };
+    static std::array<std::array<dispatch_t, (unsigned)hash_e::end>, (unsigned)collect_e::end> const  DISPATCH;
+    static std::array<std::array<weighted_t, (unsigned)hash_e::end>, (unsigned)collect_e::end> const  WEIGHTED;
+    static std::array<sparse_t, (unsigned)hash_e::end> const  SPARSE;
+    static std::array<query_t, (unsigned)hash_e::end> const  QUERY;
+    static std::array<route_t, (unsigned)hash_e::end> const  ROUTE;
+    static dispatch_t select(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, collect_e const mode, layout_e const layout);
+
+    // Bits of a row interleaved per table block: p for ROWS, fewer for LINES
+    static unsigned granule(layout_e const layout, unsigned const rows, unsigned const p, unsigned const min_g);
+    static unsigned hash_bits(hash_e const hash);
+
+    // All tables live in one slab: AGMS | CM | HLL, each cache-line aligned.
+    // Disabled sketches have zero size and take no space, nor do the HLL
+    // registers of a collector that starts sparse: densify() gives them a slab
+    // of their own.
+    // Slabs of SKT_HUGE_PAGE and beyond are mapped, smaller ones come from the heap.
+    struct slab_deleter {
+        size_t  size;       // mapped bytes, 0 for heap memory
+        void operator()(uint8_t *slab) const;
+    };
+    typedef std::unique_ptr<uint8_t[], slab_deleter>  slab_t;
+    static size_t slab_align(size_t const bytes) { return  (bytes + 63) & ~size_t(63); }
+    static size_t slab_cm(unsigned const ar_val, unsigned const ap_val) { return  slab_align(((size_t)ar_val << ap_val) * sizeof(signed)); }
+    static size_t slab_hll(unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val) {
+        return  slab_cm(ar_val, ap_val) + slab_align(((size_t)cr_val << cp_val) * sizeof(unsigned));
+    }
+    static size_t slab_size(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val) {
+        return  slab_hll(ar_val, ap_val, cr_val, cp_val) + (hp_val? slab_align(size_t(1) << hp_val) : 0);
+    }
+    static bool starts_dense(unsigned const hp_val, bool const sparse) { return  hp_val && !(sparse && (hp_val <= SKT_HLL_SPARSE_P)); }
+    static slab_t slab_alloc(size_t const bytes, pages_e const pages);
+    slab_t                      m_slab;
+    size_t const                m_slab_size;
+    slab_t                      m_slab_hll;         // registers allocated by densify()
+    pages_e const               m_pages;
 
-    //hll
+    //hll: one byte per register, ranks never exceed 129, p = 0 when disabled
     unsigned const              m_p_hll;
-    std::unique_ptr<unsigned[]> m_buckets_hll;
-    //agms
+    unsigned const              m_q_hll;            // hash bits left for the rank
+    uint8_t                    *m_buckets_hll;      // null while sparse or disabled
+    //hll sparse: open-addressing set of idx<<7 | rank entries, 0 marks a free slot
+    std::vector<uint32_t>       m_sparse_hll;
+    size_t                      m_sparse_cnt;
+    sparse_t const              m_sparse_fn;
+    //agms: no rows when disabled
     unsigned const              m_r_agms;
     unsigned const              m_p_agms;
-    std::unique_ptr<signed[]>   m_table_agms;
-    //cm
+    unsigned const              m_g_agms;
+    signed   *const             m_table_agms;
+    //cm: no rows when disabled
     unsigned const              m_r_cm;
     unsigned const              m_p_cm;
-    std::unique_ptr<unsigned[]> m_table_cm;
+    unsigned const              m_g_cm;
+    unsigned *const             m_table_cm;
 
-    dispatch_t const *const     m_dispatch;
+    dispatch_t const            m_dispatch;
+    weighted_t const            m_weighted_fn;
+    query_t const               m_query_fn;
+    route_t const               m_route_fn;
+    std::unique_ptr<partition_t, partition_deleter>  m_partition;   // null until partitioned collection
+    unsigned                    m_pf_dist;
+
+    // Geometry with the disabled sketches already zeroed
+    struct enabled_t {};
+    SktCollector(enabled_t, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, collect_e const mode, layout_e const layout, bool const sparse, pages_e const pages)
+     : m_slab(slab_alloc(slab_size(starts_dense(hp_val, sparse)? hp_val : 0, ar_val, ap_val, cr_val, cp_val), pages)),
+       m_slab_size(slab_size(starts_dense(hp_val, sparse)? hp_val : 0, ar_val, ap_val, cr_val, cp_val)), m_pages(pages),
+       m_p_hll(hp_val), m_q_hll(hash_bits(hash) - hp_val),
+       m_buckets_hll(starts_dense(hp_val, sparse)? &m_slab[slab_hll(ar_val, ap_val, cr_val, cp_val)] : nullptr),
+       m_sparse_hll((m_buckets_hll || !hp_val)? 0 : SKT_HLL_SPARSE_MIN), m_sparse_cnt(0), m_sparse_fn(SPARSE.at((unsigned)hash)),
+       m_r_agms(ar_val), m_p_agms(ap_val), m_g_agms(granule(layout, ar_val, ap_val, 1)), m_table_agms((signed*)m_slab.get()),
+       m_r_cm(cr_val), m_p_cm(cp_val), m_g_cm(granule(layout, cr_val, cp_val, 0)), m_table_cm((unsigned*)(m_slab.get() + slab_cm(ar_val, ap_val))),
+       m_dispatch(select(hp_val, ar_val, ap_val, cr_val, cp_val, hash, mode, layout)),
+       m_weighted_fn(WEIGHTED.at((unsigned)mode).at((unsigned)hash)), m_query_fn(QUERY.at((unsigned)hash)),
+       m_route_fn(ROUTE.at((unsigned)hash)), m_pf_dist(mode == collect_e::PREFETCH? SKT_PF_DIST : 0) {
+        if(!hp_val && !ar_val && !cr_val)  throw std::invalid_argument("No sketch enabled.");
+        if(sparse && (mode == collect_e::ATOMIC))  throw std::invalid_argument("A shared collector cannot start sparse.");
+    }
 
 public:
-    SktCollector(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash)
-     : m_p_hll(hp_val), m_buckets_hll(new unsigned[1<<hp_val]()), 
-       m_r_agms(ar_val), m_p_agms(ap_val), m_table_agms(new signed[(1<<ap_val)*ar_val]()),
-       m_r_cm(cr_val), m_p_cm(cp_val), m_table_cm(new unsigned[(1<<cp_val)*cr_val]()),
-       m_dispatch(&DISPATCH.at((unsigned)hash)) {}
-    
+    // A sparse collector keeps its HLL as a list of registers at SKT_HLL_SPARSE_P
+    // bits precision and only switches to dense registers once the list would
+    // outgrow them. Until then it holds no dense registers.
+    // Only the sketches in the mask are kept, see SKT_ALL.
+    SktCollector(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, collect_e const mode = collect_e::DIRECT, layout_e const layout = layout_e::ROWS, bool const sparse = false, pages_e const pages = pages_e::THP, unsigned const sketches = SKT_ALL)
+     : SktCollector(enabled_t(), (sketches & SKT_HLL)? hp_val : 0, (sketches & SKT_AGMS)? ar_val : 0, ap_val, (sketches & SKT_CM)? cr_val : 0, cp_val, hash, mode, layout, sparse, pages) {}
+
     SktCollector(SktCollector&& o)
-     : m_p_hll(o.m_p_hll), m_buckets_hll(std::move(o.m_buckets_hll)), 
-       m_r_agms(o.m_r_agms), m_p_agms(o.m_p_agms), m_table_agms(std::move(o.m_table_agms)),
-       m_r_cm(o.m_r_cm), m_p_cm(o.m_p_cm), m_table_cm(std::move(o.m_table_cm)),
-       m_dispatch(o.m_dispatch) {}
+     : m_slab(std::move(o.m_slab)), m_slab_size(o.m_slab_size), m_slab_hll(std::move(o.m_slab_hll)), m_pages(o.m_pages),
+       m_p_hll(o.m_p_hll), m_q_hll(o.m_q_hll), m_buckets_hll(o.m_buckets_hll),
+       m_sparse_hll(std::move(o.m_sparse_hll)), m_sparse_cnt(o.m_sparse_cnt), m_sparse_fn(o.m_sparse_fn),
+       m_r_agms(o.m_r_agms), m_p_agms(o.m_p_agms), m_g_agms(o.m_g_agms), m_table_agms(o.m_table_agms),
+       m_r_cm(o.m_r_cm), m_p_cm(o.m_p_cm), m_g_cm(o.m_g_cm), m_table_cm(o.m_table_cm),
+       m_dispatch(o.m_dispatch), m_weighted_fn(o.m_weighted_fn), m_query_fn(o.m_query_fn), m_route_fn(o.m_route_fn),
+       m_partition(std::move(o.m_partition)), m_pf_dist(o.m_pf_dist) {}
 
     ~SktCollector() {}
 
 public:
-    void collect(uint32_t const *data, size_t  n) { m_dispatch->f_ptr(data, n, &m_buckets_hll[0], &m_table_agms[0], &m_table_cm[0],
-                                                    m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm); }
+    // Keys are 32 (uint32_t) or 64 (uint64_t) bits wide, the same collector may see both.
+    template<typename K>
+    void collect(K const *data, size_t  n) {
+        if(!sparse())  m_dispatch.of(data)(data, n, m_buckets_hll, &m_table_agms[0], &m_table_cm[0],
+                                           m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm, m_pf_dist);
+        else           collect_sparse(data, n);
+    }
+    // String keys, see skt_strings_t. Throws for IDENT, which cannot hash them.
+    void collect(skt_strings_t const keys, size_t  n) {
+        if(!m_dispatch.f_str)  throw std::invalid_argument("IDENT cannot hash string keys.");
+        if(!sparse())  m_dispatch.f_str(keys, n, m_buckets_hll, &m_table_agms[0], &m_table_cm[0],
+                                        m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm, m_pf_dist);
+        else           collect_sparse(keys, n);
+    }
+
+    // Weighted and turnstile updates: key i counts weights[i] times, negative
+    // weights retract earlier ones from CM and AGMS. HLL only sees keys of
+    // positive weight. Throws for string keys under IDENT and for negative
+    // weights under CONSERVATIVE.
+    template<typename K>
+    void collect_weighted(K const *data, int32_t const *weights, size_t  n) {
+        if(!sparse())  m_weighted_fn.of(data)(data, weights, n, m_buckets_hll, &m_table_agms[0], &m_table_cm[0],
+                                              m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm);
+        else           collect_sparse_weighted(data, weights, n);
+    }
+    void collect_weighted(skt_strings_t const keys, int32_t const *weights, size_t  n) {
+        if(!m_weighted_fn.f_str)  throw std::invalid_argument("IDENT cannot hash string keys.");
+        if(!sparse())  m_weighted_fn.f_str(keys, weights, n, m_buckets_hll, &m_table_agms[0], &m_table_cm[0],
+                                           m_p_hll, m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm);
+        else           collect_sparse_weighted(keys, weights, n);
+    }
+
+    // Share-nothing collection of one input by num_threads threads: each thread
+    // owns a contiguous slice of every table and receives the updates that hit
+    // it from the other threads through its inbox. No replicas and no merge;
+    // the HLL is densified first. The threads are kept for the next call.
+    template<typename K>
+    void collect_partitioned(K const *data, size_t const n, unsigned const num_threads);
+
+    bool sparse() const { return  !m_buckets_hll && m_p_hll; }
+
+    // Mask of the enabled sketches
+    unsigned sketches() const { return  (m_p_hll? SKT_HLL : 0) | (m_r_agms? SKT_AGMS : 0) | (m_r_cm? SKT_CM : 0); }
+
+    // Prefetch distance in items (0 disables prefetching) for the PREFETCH and BLOCKED modes
+    void prefetch(unsigned const  dist) { m_pf_dist = dist; }
+
+private:
+    static size_t constexpr  SKT_HLL_SPARSE_MIN = 16;
+
+    // D is a key pointer or skt_strings_t
+    template<typename D>
+    void collect_sparse(D const data, size_t  n);
+    template<typename D>
+    void collect_sparse_weighted(D const data, int32_t const *weights, size_t  n);
+    // Feeds the sparse HLL until it densifies, returns the number of items consumed
+    template<typename D>
+    size_t sparse_stage(D const data, int32_t const *weights, size_t  n);
+    void sparse_insert(uint32_t const  entry);
+    void sparse_fold(uint8_t *buckets) const;
+    void densify();
 
 private:
+    // Table index of logical slot ofs of a row under the collector's layout
+    size_t agms_index(size_t const row, size_t const ofs) const {
+        return  (((ofs >> m_g_agms)*m_r_agms + row) << m_g_agms) | (ofs & ((size_t(1) << m_g_agms)-1));
+    }
+    size_t cm_index(size_t const row, size_t const ofs) const {
+        return  (((ofs >> m_g_cm)*m_r_cm + row) << m_g_cm) | (ofs & ((size_t(1) << m_g_cm)-1));
+    }
+
+private:
+    // Throws for estimates from sketches left out of the collector
+    void check_enabled(unsigned const  sketches) const;
+    void check_mergeable(SktCollector const& other) const;
     void merge0(SktCollector const& other);
 public:
     SktCollector& merge(SktCollector const& other) {
@@ -92,9 +441,31 @@ public:
         return *this;
     }
 
+    // Merges collectors[1..n) into collectors[0] in log2(n) rounds of
+    // pairwise merges spread over num_threads threads. The other
+    // collectors are left holding partial merges.
+    static void merge_tree(SktCollector *collectors, size_t const n, unsigned const num_threads);
+
+private:
+    // Number of HLL registers holding each rank
+    void hll_histogram(uint32_t (&hist)[256]) const;
 public:
     double estimate_cardinality();
 
+    // Point frequency of each key: the CM minimum over all rows into cm_out[i]
+    // and the median of the signed AGMS counters into agms_out[i]. Either
+    // output may be null to skip that sketch.
+    template<typename K>
+    void query_frequency(K const *keys, size_t  n, unsigned *cm_out, double *agms_out = nullptr) const {
+        check_enabled((cm_out? SKT_CM : 0) | (agms_out? SKT_AGMS : 0));
+        m_query_fn.of(keys)(keys, n, &m_table_agms[0], &m_table_cm[0], m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm, agms_out, cm_out);
+    }
+    void query_frequency(skt_strings_t const keys, size_t  n, unsigned *cm_out, double *agms_out = nullptr) const {
+        if(!m_query_fn.f_str)  throw std::invalid_argument("IDENT cannot hash string keys.");
+        check_enabled((cm_out? SKT_CM : 0) | (agms_out? SKT_AGMS : 0));
+        m_query_fn.f_str(keys, n, &m_table_agms[0], &m_table_cm[0], m_r_agms, m_p_agms, m_r_cm, m_p_cm, m_g_agms, m_g_cm, agms_out, cm_out);
+    }
+
 private:
     void merge0_columns(SktCollector const& other);
 public:
@@ -106,7 +477,187 @@ public:
 public:
     double get_median();
 
+private:
+    void agms_row_products(signed const *a, signed const *b, int64_t (&sums)[SKT_MAX_ROWS]) const;
+public:
+    // Second frequency moment F2 and the join size with another stream
+    // hashed alike: median over the AGMS rows of the row's (cross) products.
+    double estimate_f2() const;
+    double estimate_inner_product(SktCollector const& other) const;
+
 public:
     void clean();
 };
+
+// Sketches over the last span ticks of a stream, the caller decides what a
+// tick is. HLL registers are LFPM lists that expire by their timestamps; AGMS
+// and CM keep one table set per tick in a ring whose oldest slot is cleared
+// as the window moves on. Single writer: collect() and advance() must not run
+// concurrently with each other or with snapshot().
+class SktWindow {
+    struct window_t {
+        skt_window_fn       f_ptr;
+        skt_window64_fn     f_ptr64;
+        skt_window_str_fn   f_str;
+        skt_window_fn       of(uint32_t const*) const { return  f_ptr; }
+        skt_window64_fn     of(uint64_t const*) const { return  f_ptr64; }
+        skt_window_str_fn   of(skt_strings_t)   const { return  f_str; }
+    };
+    static std::array<window_t, (unsigned)hash_e::end> const  WINDOW;
+
+    hash_e   const              m_hash;
+    layout_e const              m_layout;
+    unsigned const              m_span;
+    uint64_t                    m_tick;
+
+    //lfpm: up to m_lfpm_cap entries per register, untouched slots are never read
+    unsigned const              m_p_hll;
+    unsigned const              m_lfpm_cap;
+    std::unique_ptr<uint64_t[]> m_lfpm;
+    std::unique_ptr<uint8_t[]>  m_lfpm_len;
+    std::unique_ptr<uint8_t[]>  m_lfpm_now;         // ranks of the current tick
+    //agms and cm of tick t live in m_ring[t % m_span], no ring without them
+    std::vector<SktCollector>   m_ring;
+    window_t const              m_window_fn;
+
+    template<typename D, typename F>
+    void collect0(D const data, size_t  n, F const  fn) {
+        if(m_ring.empty()) {
+            fn(data, n, &m_lfpm[0], &m_lfpm_len[0], &m_lfpm_now[0], m_lfpm_cap, m_tick, nullptr, nullptr, m_p_hll, 0, 1, 0, 1, 1, 1);
+            return;
+        }
+        SktCollector &sub = m_ring[m_tick % m_span];
+        fn(data, n, &m_lfpm[0], &m_lfpm_len[0], &m_lfpm_now[0], m_lfpm_cap, m_tick, &sub.m_table_agms[0], &sub.m_table_cm[0],
+           m_p_hll, sub.m_r_agms, sub.m_p_agms, sub.m_r_cm, sub.m_p_cm, sub.m_g_agms, sub.m_g_cm);
+    }
+
+public:
+    SktWindow(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, unsigned const span, layout_e const layout = layout_e::ROWS);
+
+public:
+    // Collects into the current tick
+    template<typename K>
+    void collect(K const *data, size_t  n) { collect0(data, n, m_window_fn.of(data)); }
+    void collect(skt_strings_t const keys, size_t  n) {
+        if(!m_window_fn.f_str)  throw std::invalid_argument("IDENT cannot hash string keys.");
+        collect0(keys, n, m_window_fn.f_str);
+    }
+
+    // Moves on to a later tick, expiring the ticks that fall out of the window.
+    // Earlier ticks are ignored.
+    void advance(uint64_t const  tick);
+    uint64_t tick() const { return  m_tick; }
+    unsigned span() const { return  m_span; }
+
+    // A collector covering the last span ticks up to the current one, to be
+    // queried and merged like any other.
+    SktCollector snapshot(unsigned const  span) const;
+    SktCollector snapshot() const { return  snapshot(m_span); }
+};
+
+// Tumbling windows with rollups: level 0 holds one collector per tick, level
+// k+1 one per fanout[k] intervals of level k (e.g. {60, 60} for seconds,
+// minutes and hours). A finished interval is merged into its parent when the
+// parent closes. Each level but the top keeps the intervals of the current and
+// the previous parent, the top keeps its last retain closed ones. Evicted
+// collectors are cleaned and reused for later intervals.
+class SktStore {
+    unsigned const              m_hp, m_ar, m_ap, m_cr, m_cp;
+    hash_e   const              m_hash;
+    collect_e const             m_mode;
+    layout_e const              m_layout;
+    unsigned const              m_retain;
+
+    std::vector<unsigned>       m_fanout;
+    std::vector<uint64_t>       m_len;      // ticks per interval of each level
+    std::vector<uint64_t>       m_first;    // first tick still held by each level
+    std::vector<std::map<uint64_t, SktCollector>>  m_levels;    // by interval index
+    std::vector<SktCollector>   m_pool;
+    uint64_t                    m_tick;
+
+    SktCollector take();
+    void evict(unsigned const  level, uint64_t const  tick);
+    void cover(unsigned const  level, uint64_t const  from, uint64_t const  to, SktCollector &res) const;
+
+public:
+    SktStore(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, std::vector<unsigned> const &fanout, unsigned const retain, collect_e const mode = collect_e::DIRECT, layout_e const layout = layout_e::ROWS);
+
+public:
+    // Collector of the current tick, valid until the next advance()
+    SktCollector& current();
+
+    // Closes the current tick and every interval that ends with it. Earlier ticks are ignored.
+    void advance(uint64_t const  tick);
+    uint64_t tick() const { return  m_tick; }
+
+    // Sketch of the ticks [from, to), merged from the coarsest intervals that
+    // fit. Edges whose finer intervals were evicted are rounded out to the
+    // enclosing interval. The result may be handed back through release().
+    SktCollector query(uint64_t const  from, uint64_t const  to);
+    void release(SktCollector &&c);
+};
+
+// Sketches per group (GROUP BY) for K = uint32_t or uint64_t keys. A group
+// starts out holding its raw keys in a chunk of small keys in a shared arena
+// and is answered exactly from them. Once it outgrows the chunk, the keys are
+// replayed into a collector of its own, which starts with a sparse HLL. Memory
+// grows with the groups seen and their sizes, not with any configured capacity.
+template<typename K>
+class SktGroups {
+    static uint32_t constexpr  NONE = ~UINT32_C(0);
+    struct group_t {
+        uint32_t    id;
+        uint32_t    cnt;        // keys held in the chunk
+        uint32_t    chunk;      // arena offset of the chunk, NONE while empty or once promoted
+        uint32_t    coll;       // collector, NONE while small
+    };
+
+    unsigned const              m_hp, m_ar, m_ap, m_cr, m_cp;
+    hash_e   const              m_hash;
+    collect_e const             m_mode;
+    layout_e const              m_layout;
+    unsigned const              m_small;
+
+    //directory: open addressing over group index+1, 0 marks a free slot
+    std::vector<uint32_t>       m_dir;
+    std::vector<group_t>        m_groups;
+    //small groups: chunks of the arena, sized by class and doubling as groups grow
+    std::vector<K>              m_arena;
+    std::vector<std::vector<uint32_t>>  m_free_chunks;     // per class
+    std::vector<SktCollector>   m_colls;
+
+    //batch scratch: group of each item, per-group counts and the keys sorted by group
+    std::vector<uint32_t>       m_gidx;
+    std::vector<uint32_t>       m_count;
+    std::vector<uint32_t>       m_touched;
+    std::vector<K>              m_sorted;
+
+    uint32_t find(uint32_t const  id) const;
+    uint32_t insert(uint32_t const  id);
+    // Chunk class of cnt > 0 keys and the capacity of a class, at most m_small
+    unsigned chunk_class(uint32_t const  cnt) const;
+    uint32_t chunk_cap(unsigned const  cls) const { return  std::min<uint32_t>(UINT32_C(1) << cls, m_small); }
+    uint32_t chunk_alloc(unsigned const  cls);
+    void apply(group_t &grp, K const *keys, size_t const  cnt);
+    // Sorted copy of a small group's keys
+    std::vector<K> small_keys(group_t const &grp) const;
+
+public:
+    SktGroups(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, hash_e const hash, unsigned const small = 256, collect_e const mode = collect_e::DIRECT, layout_e const layout = layout_e::ROWS);
+
+public:
+    // Adds keys[i] to the sketches of groups[i]. The batch is partitioned by
+    // group first, so each group sees one collector call per batch.
+    void collect(uint32_t const *groups, K const *keys, size_t const  n);
+
+    size_t size() const { return  m_groups.size(); }
+    size_t promoted() const { return  m_colls.size(); }
+    // Keys the arena has room for, held or in free chunks
+    size_t arena_size() const { return  m_arena.size(); }
+
+    // Unknown groups are empty
+    double estimate_cardinality(uint32_t const  group);
+    double estimate_f2(uint32_t const  group) const;
+    void query_frequency(uint32_t const  group, K const *keys, size_t const  n, unsigned *cm_out) const;
+};
 #endif
@@ -26,20 +26,31 @@
  */
 #include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "skt.hpp"
 
 #include <xmmintrin.h>
 #include <immintrin.h>
 #include <iostream>
+#include <algorithm>
+#include <utility>
+#include <memory>
+#include <stdexcept>
 
 //===========================================================================
-// Hashes
+// Hashes: keys are 32 or 64 bits wide, the 64-bit variants hash all eight
+// key bytes as a Murmur3 or SipHash message of length 8.
 template<hash_e HASH, typename TR> static inline TR hash(uint32_t const  key);
+template<hash_e HASH, typename TR> static inline TR hash(uint64_t const  key);
+// Byte strings are hashed in full (Murmur3 body loop, SipHash message blocks),
+// so that a string of a key's native bytes hashes like the key. IDENT has none.
+template<hash_e HASH, typename TR> static inline TR hash(uint8_t const *key, size_t const  len);
 
 //---------------------------------------------------------------------------
 // IDENT: *Not* a hash! Just returns the key.
 template<> inline uint32_t hash<hash_e::IDENT, uint32_t>(uint32_t const  key) { return  key; }
+template<> inline uint32_t hash<hash_e::IDENT, uint32_t>(uint64_t const  key) { return  (uint32_t)key; }
 
 //---------------------------------------------------------------------------
 // MURMUR3_32
@@ -72,6 +83,36 @@ template<> inline uint32_t hash<hash_e::MURMUR3_32, uint32_t>(uint32_t const  ke
     return  h1;
 }
 
+template<> inline uint32_t hash<hash_e::MURMUR3_32, uint32_t>(uint64_t const  key) {
+    uint32_t const SEED = 42;
+    uint32_t const LEN  = 8;
+    uint32_t const c1 = 0xcc9e2d51;
+    uint32_t const c2 = 0x1b873593;
+
+    uint32_t h1 = SEED;
+
+    // body: low word first
+    for(unsigned i = 0; i < 2; i++) {
+        uint32_t k1 = (uint32_t)(key >> 32*i);
+        k1 *= c1;
+        k1 = (k1 << 15) | (k1 >> (32 - 15));
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = (h1 << 13) | (h1 >> (32 - 13));
+        h1 = h1*5+0xe6546b64;
+    }
+
+    // finalization
+    h1 ^= LEN;
+    h1 ^= h1 >> 16;
+    h1 *= 0x85ebca6b;
+    h1 ^= h1 >> 13;
+    h1 *= 0xc2b2ae35;
+    h1 ^= h1 >> 16;
+
+    return  h1;
+}
+
 //---------------------------------------------------------------------------
 // MURMUR3_64 (truncated 128-bit hash)
 static inline uint64_t rotl64(uint64_t x, int8_t r) {
@@ -119,6 +160,38 @@ template<> inline uint64_t hash<hash_e::MURMUR3_64, uint64_t>(uint32_t const  ke
     return  h1;  //h2
 }
 
+template<> inline uint64_t hash<hash_e::MURMUR3_64, uint64_t>(uint64_t const  key) {
+    uint32_t const  SEED = 0xDEADF00D;
+    uint32_t const  LEN  = 8;
+
+    uint64_t h1 = SEED;
+    uint64_t h2 = SEED;
+
+    uint64_t c1 = UINT64_C(0x87c37b91114253d5);
+    uint64_t c2 = UINT64_C(0x4cf5ad432745937f);
+
+    uint64_t k1 = key;
+    k1 *= c1;
+    k1  = rotl64(k1,31);
+    k1 *= c2;
+    h1 ^= k1;
+
+    // finalization
+    h1 ^= LEN;
+    h2 ^= LEN;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    return  h1;  //h2
+}
+
 //MURMUR3_128
 template<> inline uint128_t hash<hash_e::MURMUR3_128, uint128_t>(uint32_t const  key) {
     uint32_t const  SEED = 0xDEADF00D;
@@ -154,9 +227,40 @@ template<> inline uint128_t hash<hash_e::MURMUR3_128, uint128_t>(uint32_t const
     output = ((uint128_t)(h2))<<64 | h1;
     return  output;
 }
+
+template<> inline uint128_t hash<hash_e::MURMUR3_128, uint128_t>(uint64_t const  key) {
+    uint32_t const  SEED = 0xDEADF00D;
+    uint32_t const  LEN  = 8;
+
+    uint64_t h1 = SEED;
+    uint64_t h2 = SEED;
+
+    uint64_t c1 = UINT64_C(0x87c37b91114253d5);
+    uint64_t c2 = UINT64_C(0x4cf5ad432745937f);
+
+    uint64_t k1 = key;
+    k1 *= c1;
+    k1  = rotl64(k1,31);
+    k1 *= c2;
+    h1 ^= k1;
+
+    // finalization
+    h1 ^= LEN;
+    h2 ^= LEN;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    return  ((uint128_t)(h2))<<64 | h1;
+}
 //---------------------------------------------------------------------------
 // SIP
-template<> inline uint64_t hash<hash_e::SIP, uint64_t>(uint32_t const  key) {
 #define SIPROUND \
     do {                   \
         v0 += v1;          \
@@ -175,6 +279,7 @@ template<> inline uint64_t hash<hash_e::SIP, uint64_t>(uint32_t const  key) {
         v2 = rotl64(v2, 32); \
     } while (0)
 
+template<> inline uint64_t hash<hash_e::SIP, uint64_t>(uint32_t const  key) {
   static unsigned const  cROUNDS = 2;
   static unsigned const  dROUNDS = 4;
 
@@ -189,83 +294,1515 @@ template<> inline uint64_t hash<hash_e::SIP, uint64_t>(uint32_t const  key) {
   v2 ^= 0xFF;
   for(unsigned i = 0; i < dROUNDS; i++)  SIPROUND;
   return  v0^v1^v1^v2;
+}
+
+// Full 8-byte message block followed by the length-only final block
+template<> inline uint64_t hash<hash_e::SIP, uint64_t>(uint64_t const  key) {
+  static unsigned const  cROUNDS = 2;
+  static unsigned const  dROUNDS = 4;
+
+  uint64_t  v0 = UINT64_C(0x736f6d6570736575);
+  uint64_t  v1 = UINT64_C(0x646f72616e646f6d);
+  uint64_t  v2 = UINT64_C(0x6c7967656e657261);
+  uint64_t  v3 = UINT64_C(0x7465646279746573);
+  v3 ^= key;
+  for(unsigned i = 0; i < cROUNDS; i++)  SIPROUND;
+  v0 ^= key;
+  uint64_t const  b = UINT64_C(8)<<56;
+  v3 ^= b;
+  for(unsigned i = 0; i < cROUNDS; i++)  SIPROUND;
+  v0 ^= b;
+  v2 ^= 0xFF;
+  for(unsigned i = 0; i < dROUNDS; i++)  SIPROUND;
+  return  v0^v1^v1^v2;
+}
+
+template<> inline uint64_t hash<hash_e::SIP, uint64_t>(uint8_t const *key, size_t const  len) {
+  static unsigned const  cROUNDS = 2;
+  static unsigned const  dROUNDS = 4;
+
+  uint64_t  v0 = UINT64_C(0x736f6d6570736575);
+  uint64_t  v1 = UINT64_C(0x646f72616e646f6d);
+  uint64_t  v2 = UINT64_C(0x6c7967656e657261);
+  uint64_t  v3 = UINT64_C(0x7465646279746573);
+
+  size_t const  nblocks = len/8;
+  for(size_t i = 0; i < nblocks; i++) {
+    uint64_t  m;
+    memcpy(&m, key + 8*i, 8);
+    v3 ^= m;
+    for(unsigned r = 0; r < cROUNDS; r++)  SIPROUND;
+    v0 ^= m;
+  }
+  uint64_t  b = (uint64_t)len << 56;
+  uint8_t const *const  tail = key + 8*nblocks;
+  for(unsigned i = 0; i < (len & 7); i++)  b |= (uint64_t)tail[i] << 8*i;
+  v3 ^= b;
+  for(unsigned i = 0; i < cROUNDS; i++)  SIPROUND;
+  v0 ^= b;
+  v2 ^= 0xFF;
+  for(unsigned i = 0; i < dROUNDS; i++)  SIPROUND;
+  return  v0^v1^v1^v2;
+}
 #undef SIPROUND
+
+//---------------------------------------------------------------------------
+// MURMUR3 over byte strings
+template<> inline uint32_t hash<hash_e::MURMUR3_32, uint32_t>(uint8_t const *key, size_t const  len) {
+    uint32_t const SEED = 42;
+    uint32_t const c1 = 0xcc9e2d51;
+    uint32_t const c2 = 0x1b873593;
+
+    uint32_t h1 = SEED;
+
+    // body
+    size_t const  nblocks = len/4;
+    for(size_t i = 0; i < nblocks; i++) {
+        uint32_t  k1;
+        memcpy(&k1, key + 4*i, 4);
+        k1 *= c1;
+        k1 = (k1 << 15) | (k1 >> (32 - 15));
+        k1 *= c2;
+        h1 ^= k1;
+        h1 = (h1 << 13) | (h1 >> (32 - 13));
+        h1 = h1*5+0xe6546b64;
+    }
+
+    // tail
+    uint8_t const *const  tail = key + 4*nblocks;
+    uint32_t  k1 = 0;
+    switch(len & 3) {
+    case 3: k1 ^= tail[2] << 16;  // fall through
+    case 2: k1 ^= tail[1] << 8;   // fall through
+    case 1: k1 ^= tail[0];
+        k1 *= c1;
+        k1 = (k1 << 15) | (k1 >> (32 - 15));
+        k1 *= c2;
+        h1 ^= k1;
+    }
+
+    // finalization
+    h1 ^= (uint32_t)len;
+    h1 ^= h1 >> 16;
+    h1 *= 0x85ebca6b;
+    h1 ^= h1 >> 13;
+    h1 *= 0xc2b2ae35;
+    h1 ^= h1 >> 16;
+
+    return  h1;
+}
+
+template<> inline uint128_t hash<hash_e::MURMUR3_128, uint128_t>(uint8_t const *key, size_t const  len) {
+    uint32_t const  SEED = 0xDEADF00D;
+
+    uint64_t h1 = SEED;
+    uint64_t h2 = SEED;
+
+    uint64_t c1 = UINT64_C(0x87c37b91114253d5);
+    uint64_t c2 = UINT64_C(0x4cf5ad432745937f);
+
+    // body
+    size_t const  nblocks = len/16;
+    for(size_t i = 0; i < nblocks; i++) {
+        uint64_t  k[2];
+        memcpy(k, key + 16*i, 16);
+        uint64_t  k1 = k[0];
+        uint64_t  k2 = k[1];
+
+        k1 *= c1; k1  = rotl64(k1,31); k1 *= c2; h1 ^= k1;
+        h1 = rotl64(h1,27); h1 += h2; h1 = h1*5+0x52dce729;
+        k2 *= c2; k2  = rotl64(k2,33); k2 *= c1; h2 ^= k2;
+        h2 = rotl64(h2,31); h2 += h1; h2 = h2*5+0x38495ab5;
+    }
+
+    // tail
+    uint8_t const *const  tail = key + 16*nblocks;
+    unsigned const  rest = len & 15;
+    uint64_t  k1 = 0;
+    uint64_t  k2 = 0;
+    for(unsigned i = rest; i > 8; i--)  k2 = (k2 << 8) | tail[i-1];
+    for(unsigned i = std::min(rest, 8u); i > 0; i--)  k1 = (k1 << 8) | tail[i-1];
+    if(rest > 8) { k2 *= c2; k2  = rotl64(k2,33); k2 *= c1; h2 ^= k2; }
+    if(rest > 0) { k1 *= c1; k1  = rotl64(k1,31); k1 *= c2; h1 ^= k1; }
+
+    // finalization
+    h1 ^= len;
+    h2 ^= len;
+
+    h1 += h2;
+    h2 += h1;
+
+    h1 = fmix64(h1);
+    h2 = fmix64(h2);
+
+    h1 += h2;
+    h2 += h1;
+
+    return  ((uint128_t)(h2))<<64 | h1;
+}
+
+template<> inline uint64_t hash<hash_e::MURMUR3_64, uint64_t>(uint8_t const *key, size_t const  len) {
+    return  (uint64_t)hash<hash_e::MURMUR3_128, uint128_t>(key, len);
 }
 
 //---------------------------------------------------------------------------
 // Exported Collection Functions
-static inline unsigned clz_nz(uint32_t const  x) { return __builtin_clz(x); }
-static inline unsigned clz_nz(uint64_t const  x) { return __builtin_clzl(x); }
-static inline unsigned clz_nz(uint128_t const  x) { 
-    uint64_t hi, lo;
-    int b = 128;
-    if((hi = x>>64) != 0) {
-        b = __builtin_clzl(hi);
-    }
-    else
-        if ((lo = x & ~0ULL) != 0) {
-            b = __builtin_clzl(lo) + 64;
-        }
 
-    return b; 
-}
+// Loop building blocks are always inlined so that the geometry-specialized
+// backends see their sketch dimensions as compile-time constants.
+#define SKT_INLINE  inline __attribute__((always_inline))
 
-template<hash_e HASH, typename T>
-static inline void skt_collect_base(uint32_t const *data, size_t const num_items, unsigned *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val) {
+// Single-item update of all three sketches from one hash value.
+//
+// The AGMS and CM tables are split into blocks that interleave 2^g slots of
+// every row (g = ag_val / cg_val). The low p-g hash bits select the block
+// shared by all rows, each row then takes its slot from its own hash slice.
+// With g = p a block is the whole table and this is the plain row-major layout.
+template<typename T>
+static SKT_INLINE void skt_update(T const hashv, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) {
 
     // hll
     unsigned const rest_c = 8*sizeof(T) - hp_val;
     // agms
-    uint32_t const  arow_stride = UINT32_C(1) << ap_val;
+    uint32_t const  ablk_mask   = (UINT32_C(1) << (ap_val-ag_val))-1;
+    uint32_t const  arow_stride = UINT32_C(1) << ag_val;
     uint32_t const  aofs_mask   = arow_stride-1;
-    unsigned const  abit_shift  = ap_val-1;
+    unsigned const  abit_shift  = ag_val-1;
     // cm
-    uint32_t const  cofs_mask   = ((UINT32_C(1) << cp_val)-1);
-    uint32_t const  crow_stride = (UINT32_C(1) << cp_val);
-    
+    uint32_t const  cblk_mask   = (UINT32_C(1) << (cp_val-cg_val))-1;
+    uint32_t const  cofs_mask   = ((UINT32_C(1) << cg_val)-1);
+    uint32_t const  crow_stride = (UINT32_C(1) << cg_val);
+
+    T ahashv = hashv >> (ap_val-ag_val);
+    T chashv = hashv >> (cp_val-cg_val);
+
+    // agms
+    signed *agms_row_base = agms_buckets + (((size_t)((uint32_t)hashv & ablk_mask) * ar_val) << ag_val);
+
+    // cm
+    unsigned *cm_row_base = cm_buckets + (((size_t)((uint32_t)hashv & cblk_mask) * cr_val) << cg_val);
+
+    // update - hll
+    if(hll_buckets) {
+        uint8_t  *const  bucket = &hll_buckets[hashv >> rest_c];
+        unsigned  const  lzcnt  = clz_nz(((hashv+1)<<hp_val)-1);
+        if(__builtin_expect(lzcnt >= *bucket, 0)) *bucket = lzcnt + 1;
+    }
+
+    // update - agms
+    for(size_t j=0; j<ar_val; j++) {
+        uint32_t const  arow_ofs = ahashv & aofs_mask;
+        ahashv >>= abit_shift;
+        agms_row_base[arow_ofs] += (ahashv&2) - 1;
+        agms_row_base += arow_stride;
+        ahashv >>= 2;
+    }
+
+    // update - cm
+    for(size_t j=0; j<cr_val; j++){
+        cm_row_base[chashv & cofs_mask]++;
+        cm_row_base += crow_stride;
+        chashv >>= cg_val;
+    }
+}
+
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_collect_base(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) {
     for(size_t i = 0; i < num_items; i++) {
-        T const hashv = hash<HASH, T>(data[i]);
-        T ahashv = hashv;
-        T chashv = hashv;
-        
+        skt_update<T>(hash<HASH, T>(data[i]), hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Blocked Collection: hash a tile of items into an L1-resident buffer, then
+// run one tight loop per sketch (and per table row) over that buffer so that
+// only a single table row is hot at a time. A non-zero pf_dist prefetches the
+// row slot of the item that many positions ahead.
+static size_t constexpr  SKT_TILE = 512;
+
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_hash_tile(K const *data, size_t const cnt, T *hashv) {
+    for(size_t i = 0; i < cnt; i++)  hashv[i] = hash<HASH, T>(data[i]);
+}
+
+// Table updates. The ATOMIC variants let several threads share one collector:
+// relaxed atomic adds on the counters, a relaxed CAS loop raising the register.
+template<bool ATOMIC, typename C>
+static SKT_INLINE void skt_add(C *const  ctr, C const  d) {
+    if(ATOMIC)  __atomic_fetch_add(ctr, d, __ATOMIC_RELAXED);
+    else        *ctr += d;
+}
+
+template<bool ATOMIC>
+static SKT_INLINE void skt_raise(uint8_t *const  bucket, unsigned const  lzcnt) {
+    if(ATOMIC) {
+        uint8_t  cur = __atomic_load_n(bucket, __ATOMIC_RELAXED);
+        if(__builtin_expect(lzcnt >= cur, 0)) {
+            while(lzcnt >= cur && !__atomic_compare_exchange_n(bucket, &cur, (uint8_t)(lzcnt + 1), true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+        }
+    }
+    else if(__builtin_expect(lzcnt >= *bucket, 0)) *bucket = lzcnt + 1;
+}
+
+template<typename T, bool ATOMIC = false>
+static SKT_INLINE void skt_tile_hll(T const *hashv, size_t const cnt, uint8_t *hll_buckets, unsigned const hp_val) {
+    unsigned const rest_c = 8*sizeof(T) - hp_val;
+    for(size_t i = 0; i < cnt; i++) {
+        T const  h = hashv[i];
+        uint8_t  *const  bucket = &hll_buckets[h >> rest_c];
+        unsigned  const  lzcnt  = clz_nz(((h+1)<<hp_val)-1);
+        skt_raise<ATOMIC>(bucket, lzcnt);
+    }
+}
+
+template<typename T, bool ATOMIC = false>
+static SKT_INLINE void skt_tile_agms(T const *hashv, size_t const cnt, signed *agms_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const ag_val, unsigned const pf_dist) {
+    unsigned const  ablk_bits  = ap_val-ag_val;
+    uint32_t const  ablk_mask  = (UINT32_C(1) << ablk_bits)-1;
+    size_t   const  ablk_size  = (size_t)ar_val << ag_val;
+    uint32_t const  aofs_mask  = (UINT32_C(1) << ag_val)-1;
+    unsigned const  abit_shift = ag_val-1;
+
+    for(unsigned j = 0; j < ar_val; j++) {
+        signed  *const  row   = agms_buckets + ((size_t)j << ag_val);
+        unsigned const  shift = ablk_bits + j*(ag_val+1);
+
+        // All hash bits consumed: every item lands on slot 0 of its block with sign -1.
+        if(shift >= 8*sizeof(T)) {
+            if(!ablk_mask)  skt_add<ATOMIC>(&row[0], -(signed)cnt);
+            else  for(size_t i = 0; i < cnt; i++)  skt_add<ATOMIC>(&row[((uint32_t)hashv[i] & ablk_mask)*ablk_size], -1);
+            continue;
+        }
+        size_t i = 0;
+        if(pf_dist) {
+            for(; i+pf_dist < cnt; i++) {
+                T const  p = hashv[i+pf_dist];
+                __builtin_prefetch(&row[((uint32_t)p & ablk_mask)*ablk_size + ((uint32_t)(p >> shift) & aofs_mask)], 1);
+                T const  v = hashv[i] >> shift;
+                skt_add<ATOMIC>(&row[((uint32_t)hashv[i] & ablk_mask)*ablk_size + ((uint32_t)v & aofs_mask)], (signed)((uint32_t)(v >> abit_shift) & 2) - 1);
+            }
+        }
+        for(; i < cnt; i++) {
+            T const  v = hashv[i] >> shift;
+            skt_add<ATOMIC>(&row[((uint32_t)hashv[i] & ablk_mask)*ablk_size + ((uint32_t)v & aofs_mask)], (signed)((uint32_t)(v >> abit_shift) & 2) - 1);
+        }
+    }
+}
+
+template<typename T, bool ATOMIC = false>
+static SKT_INLINE void skt_tile_cm(T const *hashv, size_t const cnt, unsigned *cm_buckets, unsigned const cr_val, unsigned const cp_val, unsigned const cg_val, unsigned const pf_dist) {
+    unsigned const  cblk_bits = cp_val-cg_val;
+    uint32_t const  cblk_mask = (UINT32_C(1) << cblk_bits)-1;
+    size_t   const  cblk_size = (size_t)cr_val << cg_val;
+    uint32_t const  cofs_mask = (UINT32_C(1) << cg_val)-1;
+
+    for(unsigned j = 0; j < cr_val; j++) {
+        unsigned *const  row   = cm_buckets + ((size_t)j << cg_val);
+        unsigned  const  shift = cblk_bits + j*cg_val;
+
+        // All hash bits consumed: every item lands on slot 0 of its block.
+        if(shift >= 8*sizeof(T)) {
+            if(!cblk_mask)  skt_add<ATOMIC>(&row[0], (unsigned)cnt);
+            else  for(size_t i = 0; i < cnt; i++)  skt_add<ATOMIC>(&row[((uint32_t)hashv[i] & cblk_mask)*cblk_size], 1u);
+            continue;
+        }
+        size_t i = 0;
+        if(pf_dist) {
+            for(; i+pf_dist < cnt; i++) {
+                T const  p = hashv[i+pf_dist];
+                __builtin_prefetch(&row[((uint32_t)p & cblk_mask)*cblk_size + ((uint32_t)(p >> shift) & cofs_mask)], 1);
+                skt_add<ATOMIC>(&row[((uint32_t)hashv[i] & cblk_mask)*cblk_size + ((uint32_t)(hashv[i] >> shift) & cofs_mask)], 1u);
+            }
+        }
+        for(; i < cnt; i++)  skt_add<ATOMIC>(&row[((uint32_t)hashv[i] & cblk_mask)*cblk_size + ((uint32_t)(hashv[i] >> shift) & cofs_mask)], 1u);
+    }
+}
+
+template<hash_e HASH, typename T, bool ATOMIC = false, typename K>
+static SKT_INLINE void skt_collect_blocked(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) {
+    alignas(64) T  hashv[SKT_TILE];
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_TILE);
+        skt_hash_tile<HASH, T>(&data[ofs], cnt, hashv);
+        if(hll_buckets)  skt_tile_hll<T, ATOMIC>(hashv, cnt, hll_buckets, hp_val);
+        skt_tile_agms<T, ATOMIC>(hashv, cnt, agms_buckets, ar_val, ap_val, ag_val, pf_dist);
+        skt_tile_cm  <T, ATOMIC>(hashv, cnt, cm_buckets,   cr_val, cp_val, cg_val, pf_dist);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Shared Collection: the blocked loop with atomic table updates so that many
+// threads can feed one collector instead of each filling a private replica.
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_collect_atomic(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) {
+    skt_collect_blocked<HASH, T, true>(data, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, pf_dist);
+}
+
+//---------------------------------------------------------------------------
+// Conservative-update Collection: like the blocked mode but the CM rows of an
+// item are only raised where they hold its current minimum. This needs all
+// rows read before any is written, so CM is updated item by item.
+template<typename T>
+static SKT_INLINE void skt_tile_cm_cu(T const *hashv, size_t const cnt, unsigned *cm_buckets, unsigned const cr_val, unsigned const cp_val, unsigned const cg_val, unsigned const pf_dist) {
+    uint32_t const  cblk_mask   = (UINT32_C(1) << (cp_val-cg_val))-1;
+    uint32_t const  cofs_mask   = (UINT32_C(1) << cg_val)-1;
+    uint32_t const  crow_stride = UINT32_C(1) << cg_val;
+
+    for(size_t i = 0; i < cnt; i++) {
+        if(pf_dist && (i+pf_dist < cnt)) {
+            T const   p = hashv[i+pf_dist];
+            unsigned *const  pf_blk = cm_buckets + (((size_t)((uint32_t)p & cblk_mask) * cr_val) << cg_val);
+            T  phashv = p >> (cp_val-cg_val);
+            for(size_t j = 0; j < cr_val; j++) {
+                __builtin_prefetch(&pf_blk[(j << cg_val) + (phashv & cofs_mask)], 1);
+                phashv >>= cg_val;
+            }
+        }
+
+        unsigned *const  cm_blk = cm_buckets + (((size_t)((uint32_t)hashv[i] & cblk_mask) * cr_val) << cg_val);
+        T  const  chashv = hashv[i] >> (cp_val-cg_val);
+
+        T  h = chashv;
+        unsigned  cmin = ~0u;
+        unsigned *row  = cm_blk;
+        for(size_t j = 0; j < cr_val; j++) {
+            cmin = std::min(cmin, row[h & cofs_mask]);
+            row += crow_stride;
+            h  >>= cg_val;
+        }
+
+        h   = chashv;
+        row = cm_blk;
+        for(size_t j = 0; j < cr_val; j++) {
+            unsigned &c = row[h & cofs_mask];
+            c  += (c == cmin);
+            row += crow_stride;
+            h  >>= cg_val;
+        }
+    }
+}
+
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_collect_conservative(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) {
+    alignas(64) T  hashv[SKT_TILE];
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_TILE);
+        skt_hash_tile<HASH, T>(&data[ofs], cnt, hashv);
+        if(hll_buckets)  skt_tile_hll<T>(hashv, cnt, hll_buckets, hp_val);
+        skt_tile_agms <T>(hashv, cnt, agms_buckets, ar_val, ap_val, ag_val, 0);
+        skt_tile_cm_cu<T>(hashv, cnt, cm_buckets,   cr_val, cp_val, cg_val, pf_dist);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Prefetching Collection: hashes run pf_dist items ahead of the updates so that
+// the HLL bucket and all AGMS and CM row slots of an item can be prefetched
+// before they are touched. Pays off once the tables spill out of L1/L2.
+static unsigned constexpr  SKT_PF_MAX = 64;
+
+template<typename T>
+static SKT_INLINE void skt_prefetch(T const hashv, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) {
+    uint32_t const  ablk_mask = (UINT32_C(1) << (ap_val-ag_val))-1;
+    uint32_t const  aofs_mask = (UINT32_C(1) << ag_val)-1;
+    uint32_t const  cblk_mask = (UINT32_C(1) << (cp_val-cg_val))-1;
+    uint32_t const  cofs_mask = (UINT32_C(1) << cg_val)-1;
+
+    if(hll_buckets)  __builtin_prefetch(&hll_buckets[hashv >> (8*sizeof(T) - hp_val)], 1);
+
+    signed *const  agms_blk = agms_buckets + (((size_t)((uint32_t)hashv & ablk_mask) * ar_val) << ag_val);
+    T ahashv = hashv >> (ap_val-ag_val);
+    for(size_t j=0; j<ar_val; j++) {
+        __builtin_prefetch(&agms_blk[(j << ag_val) + (ahashv & aofs_mask)], 1);
+        ahashv >>= ag_val-1;
+        ahashv >>= 2;
+    }
+
+    unsigned *const  cm_blk = cm_buckets + (((size_t)((uint32_t)hashv & cblk_mask) * cr_val) << cg_val);
+    T chashv = hashv >> (cp_val-cg_val);
+    for(size_t j=0; j<cr_val; j++) {
+        __builtin_prefetch(&cm_blk[(j << cg_val) + (chashv & cofs_mask)], 1);
+        chashv >>= cg_val;
+    }
+}
+
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_collect_prefetch(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) {
+    size_t const  dist = std::min<size_t>(std::min<size_t>(pf_dist, SKT_PF_MAX), num_items);
+
+    // hashv[0:dist) always holds the hashes of the next dist items ahead.
+    alignas(64) T  hashv[SKT_TILE + SKT_PF_MAX];
+    skt_hash_tile<HASH, T>(data, dist, hashv);
+    for(size_t k = 0; k < dist; k++)  skt_prefetch<T>(hashv[k], hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val);
+
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt   = std::min(num_items-ofs, SKT_TILE);
+        size_t const  ahead = (ofs+dist < num_items)? std::min(num_items-ofs-dist, SKT_TILE) : 0;
+        skt_hash_tile<HASH, T>(&data[ofs+dist], ahead, &hashv[dist]);
+
+        for(size_t i = 0; i < cnt; i++) {
+            if(i < ahead)  skt_prefetch<T>(hashv[i+dist], hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val);
+            skt_update<T>(hashv[i], hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val);
+        }
+        std::copy(&hashv[cnt], &hashv[dist+ahead], &hashv[0]);
+    }
+}
+
+//---------------------------------------------------------------------------
+// Radix-partitioned Collection: rows that exceed an L2-sized slice have the
+// updates of a tile counting-sorted by the slice they hit and applied slice
+// by slice while that slice is cache-hot. Rows that fit a slice gain nothing
+// from the extra pass and are updated directly as in the blocked mode.
+static unsigned constexpr  SKT_RADIX_SLICE = 16;     // 64K counters per slice: 256 KB of AGMS or CM, 64 KB of HLL
+static size_t   constexpr  SKT_RADIX_TILE  = 16384;
+
+// Tile buffers of the radix loop, allocated once per thread on first use and
+// sized for the widest hash word and the most slices (32-bit update keys)
+struct skt_radix_scratch_t {
+    std::unique_ptr<uint128_t[]>  hashv;
+    std::unique_ptr<uint32_t[]>   upd;
+    std::unique_ptr<uint32_t[]>   hist;
+
+    skt_radix_scratch_t()
+     : hashv(new uint128_t[SKT_RADIX_TILE]), upd(new uint32_t[2*SKT_RADIX_TILE]), hist(new uint32_t[(size_t(1) << (32-SKT_RADIX_SLICE)) + 2]) {}
+};
+static skt_radix_scratch_t& skt_radix_scratch() {
+    static thread_local skt_radix_scratch_t  scratch;
+    return  scratch;
+}
+
+// Partitions cnt update keys by (key >> shift) into out[] and calls apply on each in slice order.
+template<typename F>
+static SKT_INLINE void skt_radix_apply(uint32_t const *upd, size_t const cnt, unsigned const shift, size_t const num_parts, uint32_t *hist, uint32_t *out, F const &apply) {
+    std::fill(hist, hist+num_parts+1, 0);
+    for(size_t i = 0; i < cnt; i++)  hist[(upd[i] >> shift) + 1]++;
+    for(size_t p = 0; p < num_parts; p++)  hist[p+1] += hist[p];
+    for(size_t i = 0; i < cnt; i++)  out[hist[upd[i] >> shift]++] = upd[i];
+    for(size_t i = 0; i < cnt; i++)  apply(out[i]);
+}
+
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_collect_radix(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const) {
+    unsigned const  rest_c     = 8*sizeof(T) - hp_val;
+    uint32_t const  aofs_mask  = (UINT32_C(1) << ap_val)-1;
+    unsigned const  abit_shift = ap_val-1;
+    uint32_t const  cofs_mask  = (UINT32_C(1) << cp_val)-1;
+
+    // Update keys: hll idx<<8 | rank, agms ofs<<1 | sign, cm ofs (all within one row).
+    // Row-interleaved tables already keep the rows of an item together and are
+    // updated directly.
+    bool const  radix_hll  = hll_buckets && hp_val > SKT_RADIX_SLICE && hp_val <= 24;
+    bool const  radix_agms = ar_val && ap_val > SKT_RADIX_SLICE && ap_val <= 31 && ag_val == ap_val;
+    bool const  radix_cm   = cr_val && cp_val > SKT_RADIX_SLICE && cg_val == cp_val;
+    if(!radix_hll && !radix_agms && !radix_cm) {
+        skt_collect_blocked<HASH, T>(data, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, 0);
+        return;
+    }
+
+    skt_radix_scratch_t &scratch = skt_radix_scratch();
+    T        *const  hashv = reinterpret_cast<T*>(scratch.hashv.get());
+    uint32_t *const  upd   = scratch.upd.get();
+    uint32_t *const  hist  = scratch.hist.get();
+    uint32_t *const  out   = &upd[SKT_RADIX_TILE];
+
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_RADIX_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_RADIX_TILE);
+        skt_hash_tile<HASH, T>(&data[ofs], cnt, &hashv[0]);
+
+        // hll
+        if(!radix_hll) {
+            if(hll_buckets)  skt_tile_hll<T>(&hashv[0], cnt, hll_buckets, hp_val);
+        }
+        else {
+            for(size_t i = 0; i < cnt; i++) {
+                T const  h = hashv[i];
+                upd[i] = ((uint32_t)(h >> rest_c) << 8) | (clz_nz(((h+1)<<hp_val)-1) + 1);
+            }
+            skt_radix_apply(&upd[0], cnt, SKT_RADIX_SLICE+8, size_t(1) << (hp_val-SKT_RADIX_SLICE), &hist[0], out, [hll_buckets](uint32_t const  u) {
+                uint8_t  *const  bucket = &hll_buckets[u >> 8];
+                unsigned  const  rank   = u & 0xFF;
+                if(rank > *bucket)  *bucket = rank;
+            });
+        }
+
         // agms
-        signed *agms_row_base = agms_buckets;
+        if(!radix_agms)  skt_tile_agms<T>(&hashv[0], cnt, agms_buckets, ar_val, ap_val, ag_val, 0);
+        else {
+            for(unsigned j = 0; j < ar_val; j++) {
+                signed  *const  row   = agms_buckets + ((size_t)j << ap_val);
+                unsigned const  shift = j*(ap_val+1);
+                if(shift >= 8*sizeof(T)) {
+                    row[0] -= cnt;
+                    continue;
+                }
+                for(size_t i = 0; i < cnt; i++) {
+                    T const  v = hashv[i] >> shift;
+                    upd[i] = (((uint32_t)v & aofs_mask) << 1) | (((uint32_t)(v >> abit_shift) & 2) >> 1);
+                }
+                skt_radix_apply(&upd[0], cnt, SKT_RADIX_SLICE+1, size_t(1) << (ap_val-SKT_RADIX_SLICE), &hist[0], out, [row](uint32_t const  u) {
+                    row[u >> 1] += 2*(signed)(u & 1) - 1;
+                });
+            }
+        }
 
         // cm
-        unsigned *cm_row_base = cm_buckets;
+        if(!radix_cm)  skt_tile_cm<T>(&hashv[0], cnt, cm_buckets, cr_val, cp_val, cg_val, 0);
+        else {
+            for(unsigned j = 0; j < cr_val; j++) {
+                unsigned *const  row   = cm_buckets + ((size_t)j << cp_val);
+                unsigned  const  shift = j*cp_val;
+                if(shift >= 8*sizeof(T)) {
+                    row[0] += cnt;
+                    continue;
+                }
+                for(size_t i = 0; i < cnt; i++)  upd[i] = (uint32_t)(hashv[i] >> shift) & cofs_mask;
+                skt_radix_apply(&upd[0], cnt, SKT_RADIX_SLICE, size_t(1) << (cp_val-SKT_RADIX_SLICE), &hist[0], out, [row](uint32_t const  u) {
+                    row[u]++;
+                });
+            }
+        }
+    }
+}
 
-        // update - hll
-        unsigned *const  bucket = &hll_buckets[hashv >> rest_c];
-        unsigned  const  lzcnt  = clz_nz(((hashv+1)<<hp_val)-1);
-        if(__builtin_expect(lzcnt >= *bucket, 0)) *bucket = lzcnt + 1;
-        
-        // update - agms
-        for(size_t j=0; j<ar_val; j++) {
-            uint32_t const  arow_ofs = ahashv & aofs_mask;
-            ahashv >>= abit_shift;
-            agms_row_base[arow_ofs] += (ahashv&2) - 1;
-            agms_row_base += arow_stride;
-            ahashv >>= 2;
+#ifdef INCLUDE_AVX_HASHES
+//---------------------------------------------------------------------------
+// AVX Collectors: hash a whole 256-bit (or 512-bit) input block at once,
+// then update the sketches lane by lane. The produced hashes are bit-identical
+// to MURMUR3_32 and MURMUR3_64 so that sketches of both flavors can be merged.
+#if !defined(__AVX2__)
+#error "INCLUDE_AVX_HASHES requires a target with AVX2 support."
+#endif
+
+//- MURMUR3_32 --------------------------------------------------------------
+static inline __m256i rotl32x8(__m256i const  x, int const  r) {
+    return  _mm256_or_si256(_mm256_slli_epi32(x, r), _mm256_srli_epi32(x, 32-r));
+}
+static inline __m256i murmur3_32x8_body(__m256i  h1, __m256i const  key) {
+    __m256i  k1 = _mm256_mullo_epi32(key, _mm256_set1_epi32(0xcc9e2d51));
+    k1 = rotl32x8(k1, 15);
+    k1 = _mm256_mullo_epi32(k1, _mm256_set1_epi32(0x1b873593));
+    h1 = _mm256_xor_si256(h1, k1);
+    h1 = rotl32x8(h1, 13);
+    return  _mm256_add_epi32(_mm256_mullo_epi32(h1, _mm256_set1_epi32(5)), _mm256_set1_epi32(0xe6546b64));
+}
+static inline __m256i murmur3_32x8_fmix(__m256i  h1, uint32_t const  len) {
+    h1 = _mm256_xor_si256(h1, _mm256_set1_epi32(len));
+    h1 = _mm256_xor_si256(h1, _mm256_srli_epi32(h1, 16));
+    h1 = _mm256_mullo_epi32(h1, _mm256_set1_epi32(0x85ebca6b));
+    h1 = _mm256_xor_si256(h1, _mm256_srli_epi32(h1, 13));
+    h1 = _mm256_mullo_epi32(h1, _mm256_set1_epi32(0xc2b2ae35));
+    h1 = _mm256_xor_si256(h1, _mm256_srli_epi32(h1, 16));
+    return  h1;
+}
+static inline __m256i murmur3_32x8(__m256i const  key) {
+    return  murmur3_32x8_fmix(murmur3_32x8_body(_mm256_set1_epi32(42), key), 4);
+}
+// Eight 64-bit keys: split into low and high words, hashed as two blocks
+static inline __m256i murmur3_32x8(uint64_t const *keys) {
+    __m256i const  idx = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    __m256i const  a   = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((__m256i const*)&keys[0]), idx);
+    __m256i const  b   = _mm256_permutevar8x32_epi32(_mm256_loadu_si256((__m256i const*)&keys[4]), idx);
+    __m256i const  lo  = _mm256_permute2x128_si256(a, b, 0x20);
+    __m256i const  hi  = _mm256_permute2x128_si256(a, b, 0x31);
+    return  murmur3_32x8_fmix(murmur3_32x8_body(murmur3_32x8_body(_mm256_set1_epi32(42), lo), hi), 8);
+}
+#ifdef __AVX512F__
+static inline __m512i murmur3_32x16(__m512i const  key) {
+    __m512i const  c1 = _mm512_set1_epi32(0xcc9e2d51);
+    __m512i const  c2 = _mm512_set1_epi32(0x1b873593);
+
+    // body
+    __m512i  k1 = _mm512_mullo_epi32(key, c1);
+    k1 = _mm512_rol_epi32(k1, 15);
+    k1 = _mm512_mullo_epi32(k1, c2);
+    __m512i  h1 = _mm512_xor_si512(_mm512_set1_epi32(42), k1);
+    h1 = _mm512_rol_epi32(h1, 13);
+    h1 = _mm512_add_epi32(_mm512_mullo_epi32(h1, _mm512_set1_epi32(5)), _mm512_set1_epi32(0xe6546b64));
+
+    // finalization
+    h1 = _mm512_xor_si512(h1, _mm512_set1_epi32(4));
+    h1 = _mm512_xor_si512(h1, _mm512_srli_epi32(h1, 16));
+    h1 = _mm512_mullo_epi32(h1, _mm512_set1_epi32(0x85ebca6b));
+    h1 = _mm512_xor_si512(h1, _mm512_srli_epi32(h1, 13));
+    h1 = _mm512_mullo_epi32(h1, _mm512_set1_epi32(0xc2b2ae35));
+    h1 = _mm512_xor_si512(h1, _mm512_srli_epi32(h1, 16));
+    return  h1;
+}
+#endif
+
+//- MURMUR3_64 --------------------------------------------------------------
+#if defined(__AVX512DQ__) && defined(__AVX512VL__)
+static inline __m256i mul64x4(__m256i const  a, __m256i const  b) { return  _mm256_mullo_epi64(a, b); }
+#else
+static inline __m256i mul64x4(__m256i const  a, __m256i const  b) {
+    // (a_hi*2^32 + a_lo)*(b_hi*2^32 + b_lo) mod 2^64
+    __m256i const  lolo  = _mm256_mul_epu32(a, b);
+    __m256i const  cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b),
+                                            _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+    return  _mm256_add_epi64(lolo, _mm256_slli_epi64(cross, 32));
+}
+#endif
+static inline __m256i fmix64x4(__m256i  k) {
+    k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+    k = mul64x4(k, _mm256_set1_epi64x(UINT64_C(0xff51afd7ed558ccd)));
+    k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+    k = mul64x4(k, _mm256_set1_epi64x(UINT64_C(0xc4ceb9fe1a85ec53)));
+    k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 33));
+    return  k;
+}
+// Keys already widened to 64-bit lanes, len is 4 or 8 bytes
+static inline __m256i murmur3_64x4(__m256i  k1, uint64_t const  LEN) {
+    uint64_t const  SEED = 0xDEADF00D;
+
+    k1 = mul64x4(k1, _mm256_set1_epi64x(UINT64_C(0x87c37b91114253d5)));
+    k1 = _mm256_or_si256(_mm256_slli_epi64(k1, 31), _mm256_srli_epi64(k1, 64-31));
+    k1 = mul64x4(k1, _mm256_set1_epi64x(UINT64_C(0x4cf5ad432745937f)));
+
+    // finalization: h2 only depends on the constants before the first fmix
+    __m256i  h1 = _mm256_xor_si256(k1, _mm256_set1_epi64x(SEED ^ LEN));
+    __m256i  h2 = _mm256_set1_epi64x(SEED ^ LEN);
+    h1 = _mm256_add_epi64(h1, h2);
+    h2 = _mm256_add_epi64(h2, h1);
+
+    h1 = fmix64x4(h1);
+    h2 = fmix64x4(h2);
+
+    return  _mm256_add_epi64(h1, h2);
+}
+static inline __m256i murmur3_64x4(__m128i const  key) { return  murmur3_64x4(_mm256_cvtepu32_epi64(key), 4); }
+static inline __m256i murmur3_64x4(uint64_t const *keys) { return  murmur3_64x4(_mm256_loadu_si256((__m256i const*)keys), 8); }
+
+//- Block Hashes ------------------------------------------------------------
+// Hashes BLOCK consecutive keys into out[].
+template<hash_e HASH> struct avx_block;
+template<> struct avx_block<hash_e::MURMUR3_32AVX> {
+    using T = uint32_t;
+#ifdef __AVX512F__
+    static unsigned constexpr  BLOCK = 16;
+    static inline void hash(uint32_t const *data, T *out) {
+        _mm512_storeu_si512((__m512i*)out, murmur3_32x16(_mm512_loadu_si512((__m512i const*)data)));
+    }
+#else
+    static unsigned constexpr  BLOCK = 8;
+    static inline void hash(uint32_t const *data, T *out) {
+        _mm256_storeu_si256((__m256i*)out, murmur3_32x8(_mm256_loadu_si256((__m256i const*)data)));
+    }
+#endif
+    static inline void hash(uint64_t const *data, T *out) {
+        for(unsigned i = 0; i < BLOCK; i += 8)  _mm256_storeu_si256((__m256i*)&out[i], murmur3_32x8(&data[i]));
+    }
+};
+template<> struct avx_block<hash_e::MURMUR3_64AVX> {
+    using T = uint64_t;
+    static unsigned constexpr  BLOCK = 8;
+    static inline void hash(uint32_t const *data, T *out) {
+        _mm256_storeu_si256((__m256i*)&out[0], murmur3_64x4(_mm_loadu_si128((__m128i const*)&data[0])));
+        _mm256_storeu_si256((__m256i*)&out[4], murmur3_64x4(_mm_loadu_si128((__m128i const*)&data[4])));
+    }
+    static inline void hash(uint64_t const *data, T *out) {
+        _mm256_storeu_si256((__m256i*)&out[0], murmur3_64x4(&data[0]));
+        _mm256_storeu_si256((__m256i*)&out[4], murmur3_64x4(&data[4]));
+    }
+};
+
+// Scalar equivalents for the unaligned tail of an input.
+template<> inline uint32_t hash<hash_e::MURMUR3_32AVX, uint32_t>(uint32_t const  key) { return  hash<hash_e::MURMUR3_32, uint32_t>(key); }
+template<> inline uint64_t hash<hash_e::MURMUR3_64AVX, uint64_t>(uint32_t const  key) { return  hash<hash_e::MURMUR3_64, uint64_t>(key); }
+template<> inline uint32_t hash<hash_e::MURMUR3_32AVX, uint32_t>(uint64_t const  key) { return  hash<hash_e::MURMUR3_32, uint32_t>(key); }
+template<> inline uint64_t hash<hash_e::MURMUR3_64AVX, uint64_t>(uint64_t const  key) { return  hash<hash_e::MURMUR3_64, uint64_t>(key); }
+template<> inline uint32_t hash<hash_e::MURMUR3_32AVX, uint32_t>(uint8_t const *key, size_t const  len) { return  hash<hash_e::MURMUR3_32, uint32_t>(key, len); }
+template<> inline uint64_t hash<hash_e::MURMUR3_64AVX, uint64_t>(uint8_t const *key, size_t const  len) { return  hash<hash_e::MURMUR3_64, uint64_t>(key, len); }
+
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_collect_avx(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) {
+    unsigned constexpr  BLOCK = avx_block<HASH>::BLOCK;
+
+    size_t const  num_blocked = num_items - num_items%BLOCK;
+    alignas(64) T  hashv[BLOCK];
+    for(size_t i = 0; i < num_blocked; i += BLOCK) {
+        avx_block<HASH>::hash(&data[i], hashv);
+        for(unsigned  k = 0; k < BLOCK; k++) {
+            skt_update<T>(hashv[k], hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val);
+        }
+    }
+    skt_collect_base<HASH, T>(data+num_blocked, num_items-num_blocked, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, pf_dist);
+}
+
+// Tile hashing for the blocked collector
+#define IMPLEMENT(HASH, K) \
+template<> \
+inline void skt_hash_tile<hash_e::HASH, avx_block<hash_e::HASH>::T>(K const *data, size_t const cnt, avx_block<hash_e::HASH>::T *hashv) { \
+    unsigned constexpr  BLOCK = avx_block<hash_e::HASH>::BLOCK; \
+    size_t i = 0; \
+    for(; i+BLOCK <= cnt; i += BLOCK)  avx_block<hash_e::HASH>::hash(&data[i], &hashv[i]); \
+    for(; i < cnt; i++)  hashv[i] = hash<hash_e::HASH, avx_block<hash_e::HASH>::T>(data[i]); \
+}
+
+IMPLEMENT(MURMUR3_32AVX, uint32_t)
+IMPLEMENT(MURMUR3_64AVX, uint32_t)
+IMPLEMENT(MURMUR3_32AVX, uint64_t)
+IMPLEMENT(MURMUR3_64AVX, uint64_t)
+#undef IMPLEMENT
+#endif
+
+//---------------------------------------------------------------------------
+// Exported Backends
+template<hash_e HASH, collect_e MODE> struct skt_loop;
+
+// A null HLL register array (sparse or disabled HLL) is passed on as a literal
+// nullptr and row-major tables pass p itself as granule so that both fold away
+// in the loops. Without AGMS and CM rows only the HLL loop is left.
+#define IMPLEMENT(HASH, W, MODE, LOOP) \
+template<> \
+struct skt_loop<hash_e::HASH, collect_e::MODE> { \
+    template<typename K> \
+    static SKT_INLINE void collect(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) { \
+        if(!ar_val && !cr_val) { \
+            if(hll_buckets) \
+                LOOP<hash_e::HASH, uint##W##_t>(data, num_items, hll_buckets, nullptr, nullptr, hp_val, 0, ap_val, 0, cp_val, ap_val, cp_val, pf_dist); \
+        } \
+        else if(hll_buckets) \
+            layout(data, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, pf_dist); \
+        else \
+            layout(data, num_items, nullptr, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, pf_dist); \
+    } \
+    template<typename K> \
+    static SKT_INLINE void layout(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) { \
+        if((ag_val == ap_val) && (cg_val == cp_val)) \
+            LOOP<hash_e::HASH, uint##W##_t>(data, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ap_val, cp_val, pf_dist); \
+        else \
+            LOOP<hash_e::HASH, uint##W##_t>(data, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, pf_dist); \
+    } \
+}; \
+template<> \
+void skt_collect_ptr<hash_e::HASH, collect_e::MODE>(uint32_t const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) { \
+    skt_loop<hash_e::HASH, collect_e::MODE>::collect(data, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, pf_dist); \
+} \
+template<> \
+void skt_collect_ptr<hash_e::HASH, collect_e::MODE>(uint64_t const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) { \
+    skt_loop<hash_e::HASH, collect_e::MODE>::collect(data, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, pf_dist); \
+}
+
+IMPLEMENT(IDENT,         32,  DIRECT,  skt_collect_base)
+IMPLEMENT(SIP,           64,  DIRECT,  skt_collect_base)
+IMPLEMENT(MURMUR3_32,    32,  DIRECT,  skt_collect_base)
+IMPLEMENT(MURMUR3_64,    64,  DIRECT,  skt_collect_base)
+IMPLEMENT(MURMUR3_128,  128,  DIRECT,  skt_collect_base)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32,  DIRECT,  skt_collect_avx)
+IMPLEMENT(MURMUR3_64AVX, 64,  DIRECT,  skt_collect_avx)
+#endif
+
+IMPLEMENT(IDENT,         32,  BLOCKED, skt_collect_blocked)
+IMPLEMENT(SIP,           64,  BLOCKED, skt_collect_blocked)
+IMPLEMENT(MURMUR3_32,    32,  BLOCKED, skt_collect_blocked)
+IMPLEMENT(MURMUR3_64,    64,  BLOCKED, skt_collect_blocked)
+IMPLEMENT(MURMUR3_128,  128,  BLOCKED, skt_collect_blocked)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32,  BLOCKED, skt_collect_blocked)
+IMPLEMENT(MURMUR3_64AVX, 64,  BLOCKED, skt_collect_blocked)
+#endif
+
+IMPLEMENT(IDENT,         32,  PREFETCH, skt_collect_prefetch)
+IMPLEMENT(SIP,           64,  PREFETCH, skt_collect_prefetch)
+IMPLEMENT(MURMUR3_32,    32,  PREFETCH, skt_collect_prefetch)
+IMPLEMENT(MURMUR3_64,    64,  PREFETCH, skt_collect_prefetch)
+IMPLEMENT(MURMUR3_128,  128,  PREFETCH, skt_collect_prefetch)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32,  PREFETCH, skt_collect_prefetch)
+IMPLEMENT(MURMUR3_64AVX, 64,  PREFETCH, skt_collect_prefetch)
+#endif
+
+IMPLEMENT(IDENT,         32,  RADIX,   skt_collect_radix)
+IMPLEMENT(SIP,           64,  RADIX,   skt_collect_radix)
+IMPLEMENT(MURMUR3_32,    32,  RADIX,   skt_collect_radix)
+IMPLEMENT(MURMUR3_64,    64,  RADIX,   skt_collect_radix)
+IMPLEMENT(MURMUR3_128,  128,  RADIX,   skt_collect_radix)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32,  RADIX,   skt_collect_radix)
+IMPLEMENT(MURMUR3_64AVX, 64,  RADIX,   skt_collect_radix)
+#endif
+
+IMPLEMENT(IDENT,         32,  CONSERVATIVE, skt_collect_conservative)
+IMPLEMENT(SIP,           64,  CONSERVATIVE, skt_collect_conservative)
+IMPLEMENT(MURMUR3_32,    32,  CONSERVATIVE, skt_collect_conservative)
+IMPLEMENT(MURMUR3_64,    64,  CONSERVATIVE, skt_collect_conservative)
+IMPLEMENT(MURMUR3_128,  128,  CONSERVATIVE, skt_collect_conservative)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32,  CONSERVATIVE, skt_collect_conservative)
+IMPLEMENT(MURMUR3_64AVX, 64,  CONSERVATIVE, skt_collect_conservative)
+#endif
+
+IMPLEMENT(IDENT,         32,  ATOMIC,  skt_collect_atomic)
+IMPLEMENT(SIP,           64,  ATOMIC,  skt_collect_atomic)
+IMPLEMENT(MURMUR3_32,    32,  ATOMIC,  skt_collect_atomic)
+IMPLEMENT(MURMUR3_64,    64,  ATOMIC,  skt_collect_atomic)
+IMPLEMENT(MURMUR3_128,  128,  ATOMIC,  skt_collect_atomic)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32,  ATOMIC,  skt_collect_atomic)
+IMPLEMENT(MURMUR3_64AVX, 64,  ATOMIC,  skt_collect_atomic)
+#endif
+
+IMPLEMENT(IDENT,         32,  PARTITIONED, skt_collect_blocked)
+IMPLEMENT(SIP,           64,  PARTITIONED, skt_collect_blocked)
+IMPLEMENT(MURMUR3_32,    32,  PARTITIONED, skt_collect_blocked)
+IMPLEMENT(MURMUR3_64,    64,  PARTITIONED, skt_collect_blocked)
+IMPLEMENT(MURMUR3_128,  128,  PARTITIONED, skt_collect_blocked)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32,  PARTITIONED, skt_collect_blocked)
+IMPLEMENT(MURMUR3_64AVX, 64,  PARTITIONED, skt_collect_blocked)
+#endif
+#undef IMPLEMENT
+
+//---------------------------------------------------------------------------
+// Sparse HLL Encoders: turn each item into an idx<<7 | rank entry at the
+// SKT_HLL_SPARSE_P index bits of a sparse HLL. Even for 128-bit hashes the
+// rank fits into the 7 low bits.
+template<typename T>
+static SKT_INLINE void skt_hll_sparse_tile(T const *hashv, size_t const cnt, uint32_t *entries) {
+    unsigned constexpr  P = SKT_HLL_SPARSE_P;
+
+    for(size_t i = 0; i < cnt; i++) {
+        T const  h = hashv[i];
+        entries[i] = ((uint32_t)(h >> (8*sizeof(T) - P)) << 7) | (clz_nz(((h+1)<<P)-1) + 1);
+    }
+}
+
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_hll_sparse(K const *data, size_t const num_items, uint32_t *entries) {
+    alignas(64) T  hashv[SKT_TILE];
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_TILE);
+        skt_hash_tile<HASH, T>(&data[ofs], cnt, hashv);
+        skt_hll_sparse_tile<T>(hashv, cnt, &entries[ofs]);
+    }
+}
+
+#define IMPLEMENT(HASH, W) \
+template<> \
+void skt_hll_sparse_ptr<hash_e::HASH>(uint32_t const *data, size_t const num_items, uint32_t *entries) { \
+    skt_hll_sparse<hash_e::HASH, uint##W##_t>(data, num_items, entries); \
+} \
+template<> \
+void skt_hll_sparse_ptr<hash_e::HASH>(uint64_t const *data, size_t const num_items, uint32_t *entries) { \
+    skt_hll_sparse<hash_e::HASH, uint##W##_t>(data, num_items, entries); \
+}
+
+IMPLEMENT(IDENT,         32)
+IMPLEMENT(SIP,           64)
+IMPLEMENT(MURMUR3_32,    32)
+IMPLEMENT(MURMUR3_64,    64)
+IMPLEMENT(MURMUR3_128,  128)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32)
+IMPLEMENT(MURMUR3_64AVX, 64)
+#endif
+#undef IMPLEMENT
+
+//---------------------------------------------------------------------------
+// Point Queries: a tile of keys is hashed once, then each row computes the
+// slot indices of the whole tile (same slicing as skt_update) and fetches the
+// counters with gathers. CM keeps the running minimum, AGMS keeps the signed
+// counters of all rows for the median.
+
+// out[i] = min(out[i], table[idx[i]])
+static SKT_INLINE void skt_gather_min(unsigned const *table, uint32_t const *idx, size_t const cnt, unsigned *out) {
+    size_t  i = 0;
+#ifdef __AVX2__
+    for(; i+8 <= cnt; i += 8) {
+        __m256i const  vi = _mm256_load_si256((__m256i const*)&idx[i]);
+        __m256i const  vc = _mm256_i32gather_epi32((int const*)table, vi, 4);
+        __m256i const  vo = _mm256_loadu_si256((__m256i const*)&out[i]);
+        _mm256_storeu_si256((__m256i*)&out[i], _mm256_min_epu32(vo, vc));
+    }
+#endif
+    for(; i < cnt; i++)  out[i] = std::min(out[i], table[idx[i]]);
+}
+
+// out[i] = sgn[i] * table[idx[i]] with sgn[i] = +/-1
+static SKT_INLINE void skt_gather_sign(signed const *table, uint32_t const *idx, int32_t const *sgn, size_t const cnt, signed *out) {
+    size_t  i = 0;
+#ifdef __AVX2__
+    for(; i+8 <= cnt; i += 8) {
+        __m256i const  vi = _mm256_load_si256((__m256i const*)&idx[i]);
+        __m256i const  vc = _mm256_i32gather_epi32(table, vi, 4);
+        __m256i const  vs = _mm256_load_si256((__m256i const*)&sgn[i]);
+        _mm256_storeu_si256((__m256i*)&out[i], _mm256_sign_epi32(vc, vs));
+    }
+#endif
+    for(; i < cnt; i++)  out[i] = sgn[i] * table[idx[i]];
+}
+
+// Compare-exchange: a[i], b[i] = min, max
+static SKT_INLINE void skt_minmax(signed *a, signed *b, size_t const cnt) {
+    size_t  i = 0;
+#ifdef __AVX2__
+    for(; i+8 <= cnt; i += 8) {
+        __m256i const  va = _mm256_loadu_si256((__m256i const*)&a[i]);
+        __m256i const  vb = _mm256_loadu_si256((__m256i const*)&b[i]);
+        _mm256_storeu_si256((__m256i*)&a[i], _mm256_min_epi32(va, vb));
+        _mm256_storeu_si256((__m256i*)&b[i], _mm256_max_epi32(va, vb));
+    }
+#endif
+    for(; i < cnt; i++) {
+        signed const  lo = std::min(a[i], b[i]);
+        signed const  hi = std::max(a[i], b[i]);
+        a[i] = lo;
+        b[i] = hi;
+    }
+}
+
+// Keys per query tile: the median sort holds SKT_MAX_ROWS counters of each on the stack (32 KB)
+static size_t constexpr  SKT_QUERY_TILE = 128;
+
+// Answers the cnt <= SKT_QUERY_TILE hashed keys of one tile
+template<typename T>
+static SKT_INLINE void skt_query_tile(T const *hashv, size_t const cnt, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out) {
+    // cm
+    unsigned const  cblk_bits = cp_val-cg_val;
+    uint32_t const  cblk_mask = (UINT32_C(1) << cblk_bits)-1;
+    uint32_t const  cblk_size = cr_val << cg_val;
+    uint32_t const  cofs_mask = (UINT32_C(1) << cg_val)-1;
+    // agms
+    unsigned const  ablk_bits = ap_val-ag_val;
+    uint32_t const  ablk_mask = (UINT32_C(1) << ablk_bits)-1;
+    uint32_t const  ablk_size = ar_val << ag_val;
+    uint32_t const  aofs_mask = (UINT32_C(1) << ag_val)-1;
+
+    alignas(32) uint32_t  idx[SKT_QUERY_TILE];
+    alignas(32) int32_t   sgn[SKT_QUERY_TILE];
+
+    if(cm_out) {
+        std::fill(&cm_out[0], &cm_out[cnt], ~0u);
+        for(unsigned j = 0; j < cr_val; j++) {
+            unsigned const  shift = cblk_bits + j*cg_val;
+            for(size_t i = 0; i < cnt; i++) {
+                uint32_t const  t = shift < 8*sizeof(T)? (uint32_t)(hashv[i] >> shift) & cofs_mask : 0;
+                idx[i] = ((uint32_t)hashv[i] & cblk_mask)*cblk_size + (j << cg_val) + t;
+            }
+            skt_gather_min(cm_buckets, idx, cnt, &cm_out[0]);
+        }
+    }
+
+    if(agms_out) {
+        alignas(32) signed  vals[SKT_MAX_ROWS*SKT_QUERY_TILE];
+        for(unsigned j = 0; j < ar_val; j++) {
+            unsigned const  shift = ablk_bits + j*(ag_val+1);
+            for(size_t i = 0; i < cnt; i++) {
+                T const  v = shift < 8*sizeof(T)? hashv[i] >> shift : 0;
+                idx[i] = ((uint32_t)hashv[i] & ablk_mask)*ablk_size + (j << ag_val) + ((uint32_t)v & aofs_mask);
+                sgn[i] = (int32_t)((uint32_t)(v >> (ag_val-1)) & 2) - 1;
+            }
+            skt_gather_sign(agms_buckets, idx, sgn, cnt, &vals[j*SKT_QUERY_TILE]);
+        }
+        // Odd-even transposition sort of each key's counters across the rows,
+        // branch-free and vectorized over the tile.
+        for(unsigned r = 0; r < ar_val; r++) {
+            for(unsigned j = r & 1; j+1 < ar_val; j += 2)  skt_minmax(&vals[j*SKT_QUERY_TILE], &vals[(j+1)*SKT_QUERY_TILE], cnt);
+        }
+        signed const *const  mlo = &vals[((ar_val-1)/2)*SKT_QUERY_TILE];
+        signed const *const  mhi = &vals[(ar_val/2)*SKT_QUERY_TILE];
+        for(size_t i = 0; i < cnt; i++) {
+            agms_out[i] = (double(mlo[i]) + double(mhi[i]))/2;
+        }
+    }
+}
+
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_query(K const *keys, size_t const num_keys, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out) {
+    alignas(64) T  hashv[SKT_QUERY_TILE];
+    for(size_t ofs = 0; ofs < num_keys; ofs += SKT_QUERY_TILE) {
+        size_t const  cnt = std::min(num_keys-ofs, SKT_QUERY_TILE);
+        skt_hash_tile<HASH, T>(&keys[ofs], cnt, hashv);
+        skt_query_tile<T>(hashv, cnt, agms_buckets, cm_buckets, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val,
+                          agms_out? &agms_out[ofs] : nullptr, cm_out? &cm_out[ofs] : nullptr);
+    }
+}
+
+#define IMPLEMENT(HASH, W) \
+template<> \
+void skt_query_ptr<hash_e::HASH>(uint32_t const *keys, size_t const num_keys, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out) { \
+    skt_query<hash_e::HASH, uint##W##_t>(keys, num_keys, agms_buckets, cm_buckets, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, agms_out, cm_out); \
+} \
+template<> \
+void skt_query_ptr<hash_e::HASH>(uint64_t const *keys, size_t const num_keys, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out) { \
+    skt_query<hash_e::HASH, uint##W##_t>(keys, num_keys, agms_buckets, cm_buckets, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, agms_out, cm_out); \
+}
+
+IMPLEMENT(IDENT,         32)
+IMPLEMENT(SIP,           64)
+IMPLEMENT(MURMUR3_32,    32)
+IMPLEMENT(MURMUR3_64,    64)
+IMPLEMENT(MURMUR3_128,  128)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32)
+IMPLEMENT(MURMUR3_64AVX, 64)
+#endif
+#undef IMPLEMENT
+
+//---------------------------------------------------------------------------
+// Update Routers for partitioned collection: the same slot selection as the
+// blocked loops, but the updates are encoded for the owner of the slot
+// instead of being applied. hp_val 0 routes no HLL updates.
+template<hash_e HASH, typename T, typename K>
+static SKT_INLINE void skt_route(K const *data, size_t const num_items, uint64_t *updates, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) {
+    unsigned const  rest_c    = 8*sizeof(T) - hp_val;
+    // agms
+    unsigned const  ablk_bits = ap_val-ag_val;
+    uint32_t const  ablk_mask = (UINT32_C(1) << ablk_bits)-1;
+    uint32_t const  ablk_size = ar_val << ag_val;
+    uint32_t const  aofs_mask = (UINT32_C(1) << ag_val)-1;
+    // cm
+    unsigned const  cblk_bits = cp_val-cg_val;
+    uint32_t const  cblk_mask = (UINT32_C(1) << cblk_bits)-1;
+    uint32_t const  cblk_size = cr_val << cg_val;
+    uint32_t const  cofs_mask = (UINT32_C(1) << cg_val)-1;
+
+    alignas(64) T  hashv[SKT_TILE];
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_TILE);
+        skt_hash_tile<HASH, T>(&data[ofs], cnt, hashv);
+
+        for(size_t i = 0; hp_val && (i < cnt); i++) {
+            T const  h = hashv[i];
+            *updates++ = SKT_UPD_HLL | (uint64_t)(clz_nz(((h+1)<<hp_val)-1) + 1) << 32 | (uint32_t)(h >> rest_c);
+        }
+        for(unsigned j = 0; j < ar_val; j++) {
+            unsigned const  shift = ablk_bits + j*(ag_val+1);
+            for(size_t i = 0; i < cnt; i++) {
+                T const  v = shift < 8*sizeof(T)? hashv[i] >> shift : 0;
+                *updates++ = SKT_UPD_AGMS | (uint64_t)((uint32_t)(v >> ag_val) & 1) << 32
+                           | (((uint32_t)hashv[i] & ablk_mask)*ablk_size + (j << ag_val) + ((uint32_t)v & aofs_mask));
+            }
+        }
+        for(unsigned j = 0; j < cr_val; j++) {
+            unsigned const  shift = cblk_bits + j*cg_val;
+            for(size_t i = 0; i < cnt; i++) {
+                uint32_t const  t = shift < 8*sizeof(T)? (uint32_t)(hashv[i] >> shift) & cofs_mask : 0;
+                *updates++ = SKT_UPD_CM | (((uint32_t)hashv[i] & cblk_mask)*cblk_size + (j << cg_val) + t);
+            }
+        }
+    }
+}
+
+#define IMPLEMENT(HASH, W) \
+template<> \
+void skt_route_ptr<hash_e::HASH>(uint32_t const *data, size_t const num_items, uint64_t *updates, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) { \
+    skt_route<hash_e::HASH, uint##W##_t>(data, num_items, updates, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val); \
+} \
+template<> \
+void skt_route_ptr<hash_e::HASH>(uint64_t const *data, size_t const num_items, uint64_t *updates, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) { \
+    skt_route<hash_e::HASH, uint##W##_t>(data, num_items, updates, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val); \
+}
+
+IMPLEMENT(IDENT,         32)
+IMPLEMENT(SIP,           64)
+IMPLEMENT(MURMUR3_32,    32)
+IMPLEMENT(MURMUR3_64,    64)
+IMPLEMENT(MURMUR3_128,  128)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32)
+IMPLEMENT(MURMUR3_64AVX, 64)
+#endif
+#undef IMPLEMENT
+
+//---------------------------------------------------------------------------
+// String Keys: key i is the byte string bytes[offs[i] .. offs[i+1]). A tile of
+// strings is hashed into the buffer of the blocked loops, whose tile updates
+// follow. ATOMIC and CONSERVATIVE keep their own update rules, all other modes
+// share the blocked one as the hash rather than the table walk dominates.
+template<hash_e HASH, typename T>
+static SKT_INLINE void skt_hash_str_tile(uint8_t const *bytes, uint64_t const *offs, size_t const cnt, T *hashv) {
+    for(size_t i = 0; i < cnt; i++)  hashv[i] = hash<HASH, T>(&bytes[offs[i]], offs[i+1]-offs[i]);
+}
+
+template<hash_e HASH, typename T, collect_e MODE>
+static SKT_INLINE void skt_collect_str(uint8_t const *bytes, uint64_t const *offs, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) {
+    bool constexpr  ATOMIC = MODE == collect_e::ATOMIC;
+
+    alignas(64) T  hashv[SKT_TILE];
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_TILE);
+        skt_hash_str_tile<HASH, T>(bytes, &offs[ofs], cnt, hashv);
+        if(hll_buckets)  skt_tile_hll<T, ATOMIC>(hashv, cnt, hll_buckets, hp_val);
+        skt_tile_agms<T, ATOMIC>(hashv, cnt, agms_buckets, ar_val, ap_val, ag_val, pf_dist);
+        if(MODE == collect_e::CONSERVATIVE)  skt_tile_cm_cu<T>      (hashv, cnt, cm_buckets, cr_val, cp_val, cg_val, pf_dist);
+        else                                 skt_tile_cm  <T, ATOMIC>(hashv, cnt, cm_buckets, cr_val, cp_val, cg_val, pf_dist);
+    }
+}
+
+template<hash_e HASH, typename T>
+static SKT_INLINE void skt_hll_sparse_str(uint8_t const *bytes, uint64_t const *offs, size_t const num_items, uint32_t *entries) {
+    alignas(64) T  hashv[SKT_TILE];
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_TILE);
+        skt_hash_str_tile<HASH, T>(bytes, &offs[ofs], cnt, hashv);
+        skt_hll_sparse_tile<T>(hashv, cnt, &entries[ofs]);
+    }
+}
+
+template<hash_e HASH, typename T>
+static SKT_INLINE void skt_query_str(uint8_t const *bytes, uint64_t const *offs, size_t const num_keys, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out) {
+    alignas(64) T  hashv[SKT_QUERY_TILE];
+    for(size_t ofs = 0; ofs < num_keys; ofs += SKT_QUERY_TILE) {
+        size_t const  cnt = std::min(num_keys-ofs, SKT_QUERY_TILE);
+        skt_hash_str_tile<HASH, T>(bytes, &offs[ofs], cnt, hashv);
+        skt_query_tile<T>(hashv, cnt, agms_buckets, cm_buckets, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val,
+                          agms_out? &agms_out[ofs] : nullptr, cm_out? &cm_out[ofs] : nullptr);
+    }
+}
+
+#define IMPLEMENT_MODE(HASH, W, MODE) \
+template<> \
+void skt_collect_str_ptr<hash_e::HASH, collect_e::MODE>(skt_strings_t const keys, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, unsigned const pf_dist) { \
+    skt_collect_str<hash_e::HASH, uint##W##_t, collect_e::MODE>(keys.bytes, keys.offs, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, pf_dist); \
+}
+#define IMPLEMENT(HASH, W) \
+IMPLEMENT_MODE(HASH, W, DIRECT) \
+IMPLEMENT_MODE(HASH, W, BLOCKED) \
+IMPLEMENT_MODE(HASH, W, PREFETCH) \
+IMPLEMENT_MODE(HASH, W, RADIX) \
+IMPLEMENT_MODE(HASH, W, CONSERVATIVE) \
+IMPLEMENT_MODE(HASH, W, ATOMIC) \
+IMPLEMENT_MODE(HASH, W, PARTITIONED) \
+template<> \
+void skt_hll_sparse_str_ptr<hash_e::HASH>(skt_strings_t const keys, size_t const num_items, uint32_t *entries) { \
+    skt_hll_sparse_str<hash_e::HASH, uint##W##_t>(keys.bytes, keys.offs, num_items, entries); \
+} \
+template<> \
+void skt_query_str_ptr<hash_e::HASH>(skt_strings_t const keys, size_t const num_keys, signed const *agms_buckets, unsigned const *cm_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val, double *agms_out, unsigned *cm_out) { \
+    skt_query_str<hash_e::HASH, uint##W##_t>(keys.bytes, keys.offs, num_keys, agms_buckets, cm_buckets, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val, agms_out, cm_out); \
+}
+
+// IDENT has no string form
+IMPLEMENT(SIP,           64)
+IMPLEMENT(MURMUR3_32,    32)
+IMPLEMENT(MURMUR3_64,    64)
+IMPLEMENT(MURMUR3_128,  128)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32)
+IMPLEMENT(MURMUR3_64AVX, 64)
+#endif
+#undef IMPLEMENT
+#undef IMPLEMENT_MODE
+
+//---------------------------------------------------------------------------
+// Weighted Collection: item i adds weights[i] instead of 1 to its CM counters
+// and weights[i] times its sign to its AGMS counters. Only positive weights
+// raise HLL registers. The unit-weight tile loops are left untouched.
+template<typename T, bool ATOMIC>
+static SKT_INLINE void skt_tile_hll_w(T const *hashv, int32_t const *w, size_t const cnt, uint8_t *hll_buckets, unsigned const hp_val) {
+    unsigned const rest_c = 8*sizeof(T) - hp_val;
+    for(size_t i = 0; i < cnt; i++) {
+        if(w[i] <= 0)  continue;
+        T const  h = hashv[i];
+        skt_raise<ATOMIC>(&hll_buckets[h >> rest_c], clz_nz(((h+1)<<hp_val)-1));
+    }
+}
+
+template<typename T, bool ATOMIC>
+static SKT_INLINE void skt_tile_agms_w(T const *hashv, int32_t const *w, size_t const cnt, signed *agms_buckets, unsigned const ar_val, unsigned const ap_val, unsigned const ag_val) {
+    unsigned const  ablk_bits  = ap_val-ag_val;
+    uint32_t const  ablk_mask  = (UINT32_C(1) << ablk_bits)-1;
+    size_t   const  ablk_size  = (size_t)ar_val << ag_val;
+    uint32_t const  aofs_mask  = (UINT32_C(1) << ag_val)-1;
+    unsigned const  abit_shift = ag_val-1;
+
+    for(unsigned j = 0; j < ar_val; j++) {
+        signed  *const  row   = agms_buckets + ((size_t)j << ag_val);
+        unsigned const  shift = ablk_bits + j*(ag_val+1);
+        for(size_t i = 0; i < cnt; i++) {
+            // All hash bits consumed: slot 0 of the block with sign -1
+            T const  v = shift < 8*sizeof(T)? hashv[i] >> shift : 0;
+            signed const  sgn = (signed)((uint32_t)(v >> abit_shift) & 2) - 1;
+            skt_add<ATOMIC>(&row[((uint32_t)hashv[i] & ablk_mask)*ablk_size + ((uint32_t)v & aofs_mask)], sgn*w[i]);
+        }
+    }
+}
+
+template<typename T, bool ATOMIC>
+static SKT_INLINE void skt_tile_cm_w(T const *hashv, int32_t const *w, size_t const cnt, unsigned *cm_buckets, unsigned const cr_val, unsigned const cp_val, unsigned const cg_val) {
+    unsigned const  cblk_bits = cp_val-cg_val;
+    uint32_t const  cblk_mask = (UINT32_C(1) << cblk_bits)-1;
+    size_t   const  cblk_size = (size_t)cr_val << cg_val;
+    uint32_t const  cofs_mask = (UINT32_C(1) << cg_val)-1;
+
+    for(unsigned j = 0; j < cr_val; j++) {
+        unsigned *const  row   = cm_buckets + ((size_t)j << cg_val);
+        unsigned  const  shift = cblk_bits + j*cg_val;
+        for(size_t i = 0; i < cnt; i++) {
+            uint32_t const  t = shift < 8*sizeof(T)? (uint32_t)(hashv[i] >> shift) & cofs_mask : 0;
+            skt_add<ATOMIC>(&row[((uint32_t)hashv[i] & cblk_mask)*cblk_size + t], (unsigned)w[i]);
         }
+    }
+}
+
+// Conservative update: every row is raised to at least the current minimum plus the weight
+template<typename T>
+static SKT_INLINE void skt_tile_cm_cu_w(T const *hashv, int32_t const *w, size_t const cnt, unsigned *cm_buckets, unsigned const cr_val, unsigned const cp_val, unsigned const cg_val) {
+    uint32_t const  cblk_mask   = (UINT32_C(1) << (cp_val-cg_val))-1;
+    uint32_t const  cofs_mask   = (UINT32_C(1) << cg_val)-1;
+    uint32_t const  crow_stride = UINT32_C(1) << cg_val;
+
+    for(size_t i = 0; i < cnt; i++) {
+        unsigned *const  cm_blk = cm_buckets + (((size_t)((uint32_t)hashv[i] & cblk_mask) * cr_val) << cg_val);
+        T  const  chashv = hashv[i] >> (cp_val-cg_val);
 
-        // update - cm
-        for(size_t j=0; j<cr_val; j++){
-            cm_row_base[chashv & cofs_mask]++;
-            cm_row_base += crow_stride;
-            chashv >>= cp_val;
+        T  h = chashv;
+        unsigned  cmin = ~0u;
+        unsigned *row  = cm_blk;
+        for(size_t j = 0; j < cr_val; j++) {
+            cmin = std::min(cmin, row[h & cofs_mask]);
+            row += crow_stride;
+            h  >>= cg_val;
         }
+
+        unsigned const  target = cmin + (unsigned)w[i];
+        h   = chashv;
+        row = cm_blk;
+        for(size_t j = 0; j < cr_val; j++) {
+            unsigned &c = row[h & cofs_mask];
+            c  = std::max(c, target);
+            row += crow_stride;
+            h  >>= cg_val;
+        }
+    }
+}
+
+// hash_tile(ofs, cnt, hashv) hashes the keys ofs .. ofs+cnt-1
+template<typename T, collect_e MODE, typename H>
+static SKT_INLINE void skt_collect_weighted(H const &hash_tile, int32_t const *weights, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) {
+    bool constexpr  ATOMIC = MODE == collect_e::ATOMIC;
+
+    // A retraction cannot be applied conservatively, reject it before any update
+    if((MODE == collect_e::CONSERVATIVE) && std::any_of(weights, weights+num_items, [](int32_t const  w) { return  w < 0; })) {
+        throw std::invalid_argument("Conservative update takes no negative weights.");
+    }
+
+    alignas(64) T  hashv[SKT_TILE];
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_TILE);
+        hash_tile(ofs, cnt, hashv);
+        if(hll_buckets)  skt_tile_hll_w<T, ATOMIC>(hashv, &weights[ofs], cnt, hll_buckets, hp_val);
+        skt_tile_agms_w<T, ATOMIC>(hashv, &weights[ofs], cnt, agms_buckets, ar_val, ap_val, ag_val);
+        if(MODE == collect_e::CONSERVATIVE)  skt_tile_cm_cu_w<T>       (hashv, &weights[ofs], cnt, cm_buckets, cr_val, cp_val, cg_val);
+        else                                 skt_tile_cm_w  <T, ATOMIC>(hashv, &weights[ofs], cnt, cm_buckets, cr_val, cp_val, cg_val);
     }
 }
 
+#define IMPLEMENT_KEYS(HASH, W, MODE) \
+template<> \
+void skt_collect_weighted_ptr<hash_e::HASH, collect_e::MODE>(uint32_t const *data, int32_t const *weights, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) { \
+    skt_collect_weighted<uint##W##_t, collect_e::MODE>([data](size_t const ofs, size_t const cnt, uint##W##_t *hashv) { skt_hash_tile<hash_e::HASH, uint##W##_t>(&data[ofs], cnt, hashv); }, \
+        weights, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val); \
+} \
+template<> \
+void skt_collect_weighted_ptr<hash_e::HASH, collect_e::MODE>(uint64_t const *data, int32_t const *weights, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) { \
+    skt_collect_weighted<uint##W##_t, collect_e::MODE>([data](size_t const ofs, size_t const cnt, uint##W##_t *hashv) { skt_hash_tile<hash_e::HASH, uint##W##_t>(&data[ofs], cnt, hashv); }, \
+        weights, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val); \
+}
+#define IMPLEMENT_STR(HASH, W, MODE) \
+template<> \
+void skt_collect_weighted_ptr<hash_e::HASH, collect_e::MODE>(skt_strings_t const keys, int32_t const *weights, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) { \
+    skt_collect_weighted<uint##W##_t, collect_e::MODE>([keys](size_t const ofs, size_t const cnt, uint##W##_t *hashv) { skt_hash_str_tile<hash_e::HASH, uint##W##_t>(keys.bytes, &keys.offs[ofs], cnt, hashv); }, \
+        weights, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val); \
+}
+#define IMPLEMENT_MODE(HASH, W, MODE) \
+IMPLEMENT_KEYS(HASH, W, MODE) \
+IMPLEMENT_STR(HASH, W, MODE)
+#define IMPLEMENT(HASH, W, IMPL) \
+IMPL(HASH, W, DIRECT) \
+IMPL(HASH, W, BLOCKED) \
+IMPL(HASH, W, PREFETCH) \
+IMPL(HASH, W, RADIX) \
+IMPL(HASH, W, CONSERVATIVE) \
+IMPL(HASH, W, ATOMIC) \
+IMPL(HASH, W, PARTITIONED)
+
+// IDENT has no string form
+IMPLEMENT(IDENT,         32,  IMPLEMENT_KEYS)
+IMPLEMENT(SIP,           64,  IMPLEMENT_MODE)
+IMPLEMENT(MURMUR3_32,    32,  IMPLEMENT_MODE)
+IMPLEMENT(MURMUR3_64,    64,  IMPLEMENT_MODE)
+IMPLEMENT(MURMUR3_128,  128,  IMPLEMENT_MODE)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32,  IMPLEMENT_MODE)
+IMPLEMENT(MURMUR3_64AVX, 64,  IMPLEMENT_MODE)
+#endif
+#undef IMPLEMENT
+#undef IMPLEMENT_MODE
+#undef IMPLEMENT_STR
+#undef IMPLEMENT_KEYS
+
+//---------------------------------------------------------------------------
+// Sliding Windows: HLL registers kept as lists of future possible maxima
+// (LFPM), entries tick<<8 | rank with ticks rising and ranks strictly falling
+// from the head. An entry is dropped once a later one reaches its rank, so a
+// list never holds more than lfpm_cap = q+1 entries. lfpm_now holds plain HLL
+// registers of the current tick, which filter out most updates before the
+// lists are touched. AGMS and CM go to the tables of the current sub-window.
+template<typename T>
+static SKT_INLINE void skt_tile_lfpm(T const *hashv, size_t const cnt, uint64_t *lfpm, uint8_t *lfpm_len, uint8_t *lfpm_now, unsigned const lfpm_cap, uint64_t const tick, unsigned const hp_val) {
+    unsigned const  rest_c = 8*sizeof(T) - hp_val;
+    for(size_t i = 0; i < cnt; i++) {
+        T const  h = hashv[i];
+        size_t   const  reg  = (size_t)(h >> rest_c);
+        unsigned const  rank = clz_nz(((h+1)<<hp_val)-1) + 1;
+        if(__builtin_expect(rank <= lfpm_now[reg], 1))  continue;
+        lfpm_now[reg] = rank;
+
+        uint64_t *const  list = &lfpm[reg*lfpm_cap];
+        unsigned  len = lfpm_len[reg];
+        while(len && ((uint8_t)list[len-1] <= rank))  len--;
+        list[len] = (tick << 8) | rank;
+        lfpm_len[reg] = len+1;
+    }
+}
+
+// hash_tile(ofs, cnt, hashv) hashes the keys ofs .. ofs+cnt-1
+template<typename T, typename H>
+static SKT_INLINE void skt_collect_window(H const &hash_tile, size_t const num_items, uint64_t *lfpm, uint8_t *lfpm_len, uint8_t *lfpm_now, unsigned const lfpm_cap, uint64_t const tick, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) {
+    alignas(64) T  hashv[SKT_TILE];
+    for(size_t ofs = 0; ofs < num_items; ofs += SKT_TILE) {
+        size_t const  cnt = std::min(num_items-ofs, SKT_TILE);
+        hash_tile(ofs, cnt, hashv);
+        skt_tile_lfpm<T>(hashv, cnt, lfpm, lfpm_len, lfpm_now, lfpm_cap, tick, hp_val);
+        skt_tile_agms<T>(hashv, cnt, agms_buckets, ar_val, ap_val, ag_val, 0);
+        skt_tile_cm  <T>(hashv, cnt, cm_buckets,   cr_val, cp_val, cg_val, 0);
+    }
+}
+
+#define IMPLEMENT_KEYS(HASH, W) \
+template<> \
+void skt_collect_window_ptr<hash_e::HASH>(uint32_t const *data, size_t const num_items, uint64_t *lfpm, uint8_t *lfpm_len, uint8_t *lfpm_now, unsigned const lfpm_cap, uint64_t const tick, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) { \
+    skt_collect_window<uint##W##_t>([data](size_t const ofs, size_t const cnt, uint##W##_t *hashv) { skt_hash_tile<hash_e::HASH, uint##W##_t>(&data[ofs], cnt, hashv); }, \
+        num_items, lfpm, lfpm_len, lfpm_now, lfpm_cap, tick, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val); \
+} \
+template<> \
+void skt_collect_window_ptr<hash_e::HASH>(uint64_t const *data, size_t const num_items, uint64_t *lfpm, uint8_t *lfpm_len, uint8_t *lfpm_now, unsigned const lfpm_cap, uint64_t const tick, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) { \
+    skt_collect_window<uint##W##_t>([data](size_t const ofs, size_t const cnt, uint##W##_t *hashv) { skt_hash_tile<hash_e::HASH, uint##W##_t>(&data[ofs], cnt, hashv); }, \
+        num_items, lfpm, lfpm_len, lfpm_now, lfpm_cap, tick, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val); \
+}
 #define IMPLEMENT(HASH, W) \
+IMPLEMENT_KEYS(HASH, W) \
 template<> \
-void skt_collect_ptr<hash_e::HASH>(uint32_t const *data, size_t const num_items, unsigned *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val,unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val) { \
-    skt_collect_base<hash_e::HASH, uint##W##_t>(data, num_items, hll_buckets, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val); \
-}  
+void skt_collect_window_ptr<hash_e::HASH>(skt_strings_t const keys, size_t const num_items, uint64_t *lfpm, uint8_t *lfpm_len, uint8_t *lfpm_now, unsigned const lfpm_cap, uint64_t const tick, signed *agms_buckets, unsigned *cm_buckets, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val, unsigned const ag_val, unsigned const cg_val) { \
+    skt_collect_window<uint##W##_t>([keys](size_t const ofs, size_t const cnt, uint##W##_t *hashv) { skt_hash_str_tile<hash_e::HASH, uint##W##_t>(keys.bytes, &keys.offs[ofs], cnt, hashv); }, \
+        num_items, lfpm, lfpm_len, lfpm_now, lfpm_cap, tick, agms_buckets, cm_buckets, hp_val, ar_val, ap_val, cr_val, cp_val, ag_val, cg_val); \
+}
 
-IMPLEMENT(IDENT,        32)
+// IDENT has no string form
+IMPLEMENT_KEYS(IDENT,   32)
 IMPLEMENT(SIP,          64)
 IMPLEMENT(MURMUR3_32,   32)
 IMPLEMENT(MURMUR3_64,   64)
-IMPLEMENT(MURMUR3_128,  128)
+IMPLEMENT(MURMUR3_128, 128)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX, 32)
+IMPLEMENT(MURMUR3_64AVX, 64)
+#endif
+#undef IMPLEMENT
+#undef IMPLEMENT_KEYS
+
+//---------------------------------------------------------------------------
+// Tile Hashing for the compile-time composed collectors (skt_static.hpp)
+#define IMPLEMENT_KEYS(HASH) \
+template<> \
+void skt_hash_ptr<hash_e::HASH>(uint32_t const *data, size_t const num_items, skt_word<hash_e::HASH>::type *hashv) { \
+    skt_hash_tile<hash_e::HASH, skt_word<hash_e::HASH>::type>(data, num_items, hashv); \
+} \
+template<> \
+void skt_hash_ptr<hash_e::HASH>(uint64_t const *data, size_t const num_items, skt_word<hash_e::HASH>::type *hashv) { \
+    skt_hash_tile<hash_e::HASH, skt_word<hash_e::HASH>::type>(data, num_items, hashv); \
+}
+#define IMPLEMENT(HASH) \
+IMPLEMENT_KEYS(HASH) \
+template<> \
+void skt_hash_ptr<hash_e::HASH>(skt_strings_t const keys, size_t const num_items, skt_word<hash_e::HASH>::type *hashv) { \
+    skt_hash_str_tile<hash_e::HASH, skt_word<hash_e::HASH>::type>(keys.bytes, keys.offs, num_items, hashv); \
+}
+
+// IDENT has no string form
+IMPLEMENT_KEYS(IDENT)
+IMPLEMENT(SIP)
+IMPLEMENT(MURMUR3_32)
+IMPLEMENT(MURMUR3_64)
+IMPLEMENT(MURMUR3_128)
+#ifdef INCLUDE_AVX_HASHES
+IMPLEMENT(MURMUR3_32AVX)
+IMPLEMENT(MURMUR3_64AVX)
+#endif
 #undef IMPLEMENT
+#undef IMPLEMENT_KEYS
+
+//---------------------------------------------------------------------------
+// Geometry-specialized Backends: the same loops instantiated with constant
+// sketch dimensions so that row loops unroll and shifts and masks fold.
+// They are only registered for the row-major table layout and the streaming
+// modes, everything else takes the generic backend.
+template<hash_e HASH, collect_e MODE, unsigned HP, unsigned AR, unsigned AP, unsigned CR, unsigned CP, typename K>
+static void skt_collect_fixed(K const *data, size_t const num_items, uint8_t *hll_buckets, signed *agms_buckets, unsigned *cm_buckets, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned const pf_dist) {
+    skt_loop<HASH, MODE>::collect(data, num_items, hll_buckets, agms_buckets, cm_buckets, HP, AR, AP, CR, CP, AP, CP, pf_dist);
+}
+
+template<typename F>
+using skt_fixed_table_t = std::array<std::array<F, (unsigned)hash_e::end>, (unsigned)collect_e::end>;
+
+static constexpr bool skt_fixed_mode(collect_e const  mode) {
+    return  (mode == collect_e::DIRECT) || (mode == collect_e::BLOCKED) || (mode == collect_e::PREFETCH);
+}
+
+template<unsigned HP, unsigned AR, unsigned AP, unsigned CR, unsigned CP>
+struct skt_fixed_geometry {
+    template<typename K>
+    using row_t = std::array<void (*)(K const*, size_t, uint8_t*, signed*, unsigned*, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned, unsigned), (unsigned)hash_e::end>;
+
+    template<typename K, collect_e MODE, size_t... H>
+    static constexpr row_t<K> hashes(std::true_type, std::index_sequence<H...>) {
+        return {{ skt_collect_fixed<(hash_e)H, MODE, HP, AR, AP, CR, CP, K>... }};
+    }
+    template<typename K, collect_e MODE, size_t... H>
+    static constexpr row_t<K> hashes(std::false_type, std::index_sequence<H...>) {
+        return {{}};
+    }
+    template<typename K, typename F, size_t... M>
+    static constexpr skt_fixed_table_t<F> modes(std::index_sequence<M...>) {
+        return {{ hashes<K, (collect_e)M>(std::integral_constant<bool, skt_fixed_mode((collect_e)M)>(), std::make_index_sequence<(unsigned)hash_e::end>())... }};
+    }
+    template<typename K, typename F>
+    static constexpr skt_fixed_table_t<F> table() {
+        return  modes<K, F>(std::make_index_sequence<(unsigned)collect_e::end>());
+    }
+};
+
+static struct {
+    unsigned                            hp_val, ar_val, ap_val, cr_val, cp_val;
+    skt_fixed_table_t<skt_collect_fn>   f_ptr;
+    skt_fixed_table_t<skt_collect64_fn> f_ptr64;
+} const  SKT_FIXED[] = {
+#define FIXED(HP, AR, AP, CR, CP)  { HP, AR, AP, CR, CP, \
+    skt_fixed_geometry<HP, AR, AP, CR, CP>::table<uint32_t, skt_collect_fn>(), \
+    skt_fixed_geometry<HP, AR, AP, CR, CP>::table<uint64_t, skt_collect64_fn>() }
+    FIXED(13, 5, 13, 5, 13),    // sketch_tcp_server, sketch_fileclient
+    FIXED(16, 6, 13, 6, 13),    // FPGA kernel
+    FIXED(13, 0,  0, 0,  0),    // HLL-only (SKT_HLL) collectors of the above
+    FIXED(16, 0,  0, 0,  0),
+#undef FIXED
+};
+
+// The width of a table without rows does not matter
+static decltype(&SKT_FIXED[0]) skt_fixed_find(unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val) {
+    for(auto const &g : SKT_FIXED) {
+        if((g.hp_val == hp_val) && (g.ar_val == ar_val) && (!ar_val || (g.ap_val == ap_val)) && (g.cr_val == cr_val) && (!cr_val || (g.cp_val == cp_val)))  return  &g;
+    }
+    return  nullptr;
+}
+
+skt_collect_fn skt_collect_fixed_ptr(hash_e const hash, collect_e const mode, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val) {
+    auto const  g = skt_fixed_find(hp_val, ar_val, ap_val, cr_val, cp_val);
+    return  g? g->f_ptr.at((unsigned)mode).at((unsigned)hash) : nullptr;
+}
+
+skt_collect64_fn skt_collect_fixed64_ptr(hash_e const hash, collect_e const mode, unsigned const hp_val, unsigned const ar_val, unsigned const ap_val, unsigned const cr_val, unsigned const cp_val) {
+    auto const  g = skt_fixed_find(hp_val, ar_val, ap_val, cr_val, cp_val);
+    return  g? g->f_ptr64.at((unsigned)mode).at((unsigned)hash) : nullptr;
+}
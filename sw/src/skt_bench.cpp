@@ -35,17 +35,28 @@
 
 #include <vector>
 #include <thread>
+#include <functional>
 
 #include <fstream>
+#include <sstream>
+#include <string>
 
 #include "skt.hpp"
+#include "skt_topology.hpp"
 
 int main(int argc, char* argv[]) {
 
     // Validate and Capture Arguments
-    if (argc != 10) {
-        std::cout << "Usage: " << argv[0] << " '<hash>' <num_items> <hll_bucket_bits> <fagsm_num_rows> <fagms_bucket_bits> <cm_num_rows> <cm_bucket_bits> <num_threads> <repetitions>\n\n  Hashes:\n";
+    if ((argc < 10) || (argc > 14)) {
+        std::cout << "Usage: " << argv[0] << " '<hash>' <num_items> <hll_bucket_bits> <fagsm_num_rows> <fagms_bucket_bits> <cm_num_rows> <cm_bucket_bits> <num_threads> <repetitions> ['<collect_mode>[:<prefetch_dist>][,...]' ['<table_layout>' ['<pages>' [<keys>]]]]\n\n  Hashes:\n";
         for(unsigned i = 0; i < (unsigned)hash_e::end; i++) std::cout << '\t' << name_of((hash_e)i) << '\n';
+        std::cout << "\n  Collect Modes:\n";
+        for(unsigned i = 0; i < (unsigned)collect_e::end; i++) std::cout << '\t' << name_of((collect_e)i) << '\n';
+        std::cout << "\n  Table Layouts:\n";
+        for(unsigned i = 0; i < (unsigned)layout_e::end; i++) std::cout << '\t' << name_of((layout_e)i) << '\n';
+        std::cout << "\n  Pages:\n";
+        for(unsigned i = 0; i < (unsigned)pages_e::end; i++) std::cout << '\t' << name_of((pages_e)i) << '\n';
+        std::cout << "\n  Keys:\n\t32 (default)\n\t64\n\tSTR\n";
         std::cout << std::endl;
         return  1;
     }
@@ -54,6 +65,50 @@ int main(int argc, char* argv[]) {
         std::cerr << "Unknown hash '" << argv[1] << '\'' << std::endl;
         return  1;
     }
+    // Collect modes to compare, each with an optional prefetch distance
+    struct bench_mode_t {
+        std::string  name;
+        collect_e    mode;
+        int          pf_dist;   // -1: mode default
+    };
+    std::vector<bench_mode_t>  modes;
+    {
+        std::stringstream  ss(argc > 10? argv[10] : name_of(collect_e::DIRECT));
+        std::string  tok;
+        while(std::getline(ss, tok, ',')) {
+            size_t const     sep  = tok.find(':');
+            collect_e const  mode = value_of<collect_e>(tok.substr(0, sep).c_str());
+            if(mode == collect_e::end) {
+                std::cerr << "Unknown collect mode '" << tok.substr(0, sep) << '\'' << std::endl;
+                return  1;
+            }
+            modes.push_back({ tok, mode, sep == std::string::npos? -1 : (int)strtoul(tok.c_str()+sep+1, nullptr, 0) });
+        }
+    }
+    layout_e const  layout = argc > 11? value_of<layout_e>(argv[11]) : layout_e::ROWS;
+    if(layout == layout_e::end) {
+        std::cerr << "Unknown table layout '" << argv[11] << '\'' << std::endl;
+        return  1;
+    }
+    pages_e const  pages = argc > 12? value_of<pages_e>(argv[12]) : pages_e::THP;
+    if(pages == pages_e::end) {
+        std::cerr << "Unknown page kind '" << argv[12] << '\'' << std::endl;
+        return  1;
+    }
+    // Key width in bits, 0 for variable-length strings
+    unsigned const key_bits = argc <= 13? 32 : std::string(argv[13]) == "STR"? 0 : strtoul(argv[13], nullptr, 0);
+    if((key_bits != 0) && (key_bits != 32) && (key_bits != 64)) {
+        std::cerr << "Keys must be 32, 64 or STR." << std::endl;
+        return  1;
+    }
+    if(!key_bits && (hash == hash_e::IDENT)) {
+        std::cerr << "IDENT cannot hash string keys." << std::endl;
+        return  1;
+    }
+    if(!key_bits && std::any_of(modes.begin(), modes.end(), [](bench_mode_t const &bm) { return  bm.mode == collect_e::PARTITIONED; })) {
+        std::cerr << "PARTITIONED does not take string keys." << std::endl;
+        return  1;
+    }
     unsigned const per_block = 256/32;
 
     size_t const num_items = strtoul(argv[2], nullptr, 0);
@@ -71,8 +126,8 @@ int main(int argc, char* argv[]) {
     }
 
     unsigned const ar_val = strtoul(argv[4], nullptr, 0);
-    if((ar_val < 1) || (ar_val > 8)) {
-        std::cerr << "AGMS num_rows out of valid range [1:8]." << std::endl;
+    if(ar_val > 8) {
+        std::cerr << "AGMS num_rows out of valid range [0:8]." << std::endl;
         return  1;
     }
 
@@ -83,8 +138,8 @@ int main(int argc, char* argv[]) {
     }
 
     unsigned const cr_val = strtoul(argv[6], nullptr, 0);
-    if((cr_val < 1) || (cr_val > 8)) {
-        std::cerr << "CM num_rows out of valid range [1:8]." << std::endl;
+    if(cr_val > 8) {
+        std::cerr << "CM num_rows out of valid range [0:8]." << std::endl;
         return  1;
     }
 
@@ -94,7 +149,14 @@ int main(int argc, char* argv[]) {
         return  1;
     }
     
+    // A zero HLL precision or row count leaves that sketch out
+    if(!hp_val && !ar_val && !cr_val) {
+        std::cerr << "No sketch enabled." << std::endl;
+        return  1;
+    }
+
     unsigned const num_cores = std::thread::hardware_concurrency();
+    SktTopology const &topo = SktTopology::get();
      
     unsigned const repetitions = strtoul(argv[9], nullptr, 0);
 
@@ -105,164 +167,216 @@ int main(int argc, char* argv[]) {
         << " P_fagms=" << ap_val
         << " R_cm=" << cr_val
         << " P_cm=" << cp_val
-        << " T=" << num_threads << " (mod " << num_cores << " cores)" 
+        << " L=" << name_of(layout)
+        << " Pages=" << name_of(pages)
+        << " K=" << (key_bits? std::to_string(key_bits) : "STR")
+        << " T=" << num_threads << " (mod " << num_cores << " cores, " << topo.nodes() << " nodes)" 
         << " Repetitions=" << repetitions << std::endl;
 
-    // Frequency square through AGMS
-    std::vector<SktCollector> collectors;
-    for(unsigned i = 0; i < num_threads; i++)  collectors.emplace_back(hp_val, ar_val, ap_val, cr_val, cp_val, hash);
-    
-    SktCollector collector_cols(0, ar_val, 1, 0, 0, hash);  
+    // Runs f(i, ofs, cnt) on thread i bound to its cpu for each input slice
+    //  - split as evenly as possible at 32-byte boundaries
+    auto const  on_threads = [&](std::function<void(unsigned, size_t, size_t)> const &f) {
+        std::vector<std::thread> threads;
+        size_t ofs = 0;
+        for(unsigned i = 0; i < num_threads; i++) {
+            size_t const  nofs = (((i+1)*num_blocks)/num_threads) * per_block;
+            threads.emplace_back([&f, &topo, num_threads, i, ofs, nofs]() {
+                SktTopology::pin_cpu(topo.cpu_of(i, num_threads));
+                f(i, ofs, nofs-ofs);
+            });
+            ofs = nofs;
+        }
+        for(std::thread& t : threads) t.join();
+    };
 
     // Allocate & Populate Input Memory
-    std::unique_ptr<uint32_t[]> input{new uint32_t[num_items]};
-    for(unsigned i = 0; i < num_items; i++) input[i] = i;
-    
-    std::vector<float> durations_collect;
-    std::vector<float> durations_total;
- 
-    double cardest = 0.0;
-    double median  = 0.0;
-
-    for(unsigned r=0; r<repetitions; r++) {
-        // Threaded Skt Table Collection
-        //  - split as evenly as possible at 32-byte boundaries
-        auto const t0 = std::chrono::system_clock::now();
-        {
-            std::vector<std::thread> threads;
-
-            size_t ofs = 0;
-            for(unsigned i = 0; i < num_threads; i++) {
-                size_t const  nofs  = (((i+1)*num_blocks)/num_threads) * per_block;
-
-                size_t const  cnt = nofs-ofs;
-                SktCollector& clct(collectors[i]);
-                threads.emplace_back([&clct, data=&input[ofs], cnt](){ clct.collect(data, cnt); });
-                cpu_set_t  cpus;
-                CPU_ZERO(&cpus);
-                CPU_SET((2*i)%num_cores, &cpus);
-                pthread_setaffinity_np(threads.back().native_handle(), sizeof(cpus), &cpus);
-                ofs = nofs;
-            }   
-            // Wait for all to finish
-            for(std::thread& t : threads) t.join();
+    //  - each slice is first touched by its thread so that its pages land on that thread's node
+    //  - 64-bit keys are spread over the whole key space by a multiplicative (bijective) mix
+    //  - string keys are the decimal forms of those, packed into one arena
+    std::unique_ptr<uint32_t[]> input;
+    std::unique_ptr<uint64_t[]> input64;
+    std::vector<uint8_t>        str_bytes;
+    std::vector<uint64_t>       str_offs;
+    size_t  input_bytes = (key_bits/8)*num_items;
+    if(key_bits == 32) {
+        input.reset(new uint32_t[num_items]);
+        on_threads([&input](unsigned, size_t ofs, size_t cnt) { for(size_t i = ofs; i < ofs+cnt; i++) input[i] = i; });
+    }
+    else if(key_bits == 64) {
+        input64.reset(new uint64_t[num_items]);
+        on_threads([&input64](unsigned, size_t ofs, size_t cnt) { for(size_t i = ofs; i < ofs+cnt; i++) input64[i] = i*UINT64_C(0x9E3779B97F4A7C15); });
+    }
+    else {
+        str_offs.reserve(num_items+1);
+        str_offs.push_back(0);
+        for(size_t i = 0; i < num_items; i++) {
+            std::string const  key = std::to_string(i*UINT64_C(0x9E3779B97F4A7C15));
+            str_bytes.insert(str_bytes.end(), key.begin(), key.end());
+            str_offs.push_back(str_bytes.size());
         }
-
-        // Compact into first Table 
-        auto const t1 = std::chrono::system_clock::now();
-        for(unsigned  i = 1; i < num_threads; i++) {
-            collectors[0].merge(collectors[i]);
+        input_bytes = str_bytes.size();
+    }
+    skt_strings_t const  strings { str_bytes.data(), str_offs.data() };
+
+    for(bench_mode_t const &bm : modes) {
+        collect_e const  mode = bm.mode;
+
+        // Frequency square through AGMS
+        //  - ATOMIC threads share a single collector, PARTITIONED threads own a slice
+        //    of a single collector, all others fill a replica each
+        bool     const  single = (mode == collect_e::ATOMIC) || (mode == collect_e::PARTITIONED);
+        unsigned const  num_collectors = single? 1 : num_threads;
+        //  - tables are allocated and zeroed on the cpu of their thread (first touch)
+        std::vector<SktCollector> collectors;
+        collectors.reserve(num_collectors);
+        for(unsigned i = 0; i < num_collectors; i++)  {
+            std::thread  t([&]() {
+                SktTopology::pin_cpu(topo.cpu_of(i, num_threads));
+                collectors.emplace_back(hp_val, ar_val, ap_val, cr_val, cp_val, hash, mode, layout, false, pages);
+            });
+            t.join();
+            if(bm.pf_dist >= 0)  collectors.back().prefetch(bm.pf_dist);
         }
 
-        cardest = collectors[0].estimate_cardinality();
-
-        collector_cols.merge_columns(collectors[0]);
-        median = collector_cols.get_median();
+        std::vector<float> durations_collect;
+        std::vector<float> durations_total;
+ 
+        double cardest = 0.0;
+        double f2est   = 0.0;
 
-        auto const t2 = std::chrono::system_clock::now();
+        for(unsigned r=0; r<repetitions; r++) {
+            // Threaded Skt Table Collection
+            //  - thread i works on the input slice and collector placed on its node
+            auto const t0 = std::chrono::system_clock::now();
+            if(mode == collect_e::PARTITIONED) {
+                if(input)  collectors[0].collect_partitioned(&input  [0], num_items, num_threads);
+                else       collectors[0].collect_partitioned(&input64[0], num_items, num_threads);
+            }
+            else  on_threads([&](unsigned i, size_t ofs, size_t cnt) {
+                if(input)         collectors[i % num_collectors].collect(&input  [ofs], cnt);
+                else if(input64)  collectors[i % num_collectors].collect(&input64[ofs], cnt);
+                else              collectors[i % num_collectors].collect(strings + ofs, cnt);
+            });
+
+            // Compact into first Table: node-local merges before the cross-node one
+            auto const t1 = std::chrono::system_clock::now();
+            topo.merge(collectors.data(), num_collectors, num_threads);
+
+            if(hp_val)  cardest = collectors[0].estimate_cardinality();
+
+            if(ar_val)  f2est   = collectors[0].estimate_f2();
+
+            auto const t2 = std::chrono::system_clock::now();
     
-        float const d0 = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
-        float const d1 = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t0).count();
+            float const d0 = std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+            float const d1 = std::chrono::duration_cast<std::chrono::nanoseconds>(t2 - t0).count();
         
-        durations_collect.push_back(d0); 
-        durations_total.push_back(d1);
-
-        for(unsigned  i = 0; i < num_threads; i++) collectors[i].clean();
-
-        collector_cols.clean();
-    }     
-
-    // Report Measurements
-  double const std_error = (cardest/(double)num_items - 1.0) * 100.0;
-  double const ref_error = 100.0*(1.04/sqrt(1<<hp_val));
-  std::cout << std::fixed << std::setprecision(4)
-      << "  Estimated Cardinality: " << cardest << "\t[exp: " << num_items << ']' << std::endl
-      << "  Standard Error: " << std_error << "%\t[limit: " << ref_error << "%]";
-//  if(fabs(std_error) > ref_error) std::cout << "\t! OUT OF RANGE !";
-//    
-  std::cout<<std::endl;
-
-  std::cout<< std::fixed << std::setprecision(4)
-          << "  Median: " << median <<  std::endl;
-
-//  float const d0 = std::chrono::duration_cast<std::chrono::milliseconds>(t1 - t0).count()/1000.f;
-//  float const d1 = std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t0).count()/1000.f;
-//  std::cout
-//      << std::endl << std::setprecision(3)
-//      << "  Collection Time: " << d0 << " s" << "\t[" << (4*num_items)/d0/1000000.f << " MByte/s]" << std::endl
-//      << "  Total Time: " << d1 << " s" << std::endl;
-
-    //Get stats
-    //collect-throughtput
-    std::vector<float> th_collect;
-    for(unsigned i=0; i<2; i++) {
-        for(unsigned r=0; r<repetitions; r++) {
-            if(i==0)
-                th_collect.push_back((4*num_items)/durations_collect[r]);
-            else
-                th_collect.push_back((4*num_items)/durations_total[r]);
+            durations_collect.push_back(d0); 
+            durations_total.push_back(d1);
+
+            for(unsigned  i = 0; i < num_collectors; i++) collectors[i].clean();
+        }     
+
+        // Report Measurements
+        if(hp_val) {
+            double const std_error = (cardest/(double)num_items - 1.0) * 100.0;
+            double const ref_error = 100.0*(1.04/sqrt(1<<hp_val));
+            std::cout << std::fixed << std::setprecision(4)
+                  << "  Estimated Cardinality: " << cardest << "\t[exp: " << num_items << ']' << std::endl
+                  << "  Standard Error: " << std_error << "%\t[limit: " << ref_error << "%]" << std::endl;
+        }
+        if(ar_val) {
+            std::cout << std::fixed << std::setprecision(4)
+                  << "  F2 Estimate: " << f2est << std::endl;
         }
 
-        std::sort(th_collect.begin(),th_collect.end());
+        std::vector<float> th_median(durations_collect);
+        std::sort(th_median.begin(), th_median.end());
+        std::cout << std::fixed << std::setprecision(4)
+              << "  [" << bm.name << "] Collect Throughput: " << input_bytes/th_median[(repetitions-1)/2] << " GB/s, "
+              << (1000*num_items)/th_median[(repetitions-1)/2] << " Mitems/s (median)" << std::endl;
+        std::vector<float> tt_median(durations_total);
+        std::sort(tt_median.begin(), tt_median.end());
+        std::cout << std::fixed << std::setprecision(4)
+              << "  [" << bm.name << "] Total Throughput:   " << input_bytes/tt_median[(repetitions-1)/2] << " GB/s, "
+              << (1000*num_items)/tt_median[(repetitions-1)/2] << " Mitems/s (median, incl. merge)" << std::endl;
+
+        //Get stats
+        //collect-throughtput
+        std::vector<float> th_collect;
+        for(unsigned i=0; i<2; i++) {
+            for(unsigned r=0; r<repetitions; r++) {
+                if(i==0)
+                    th_collect.push_back(input_bytes/durations_collect[r]);
+                else
+                    th_collect.push_back(input_bytes/durations_total[r]);
+            }
+
+            std::sort(th_collect.begin(),th_collect.end());
     
-        float min = th_collect[0];
-        float max = th_collect[repetitions-1];
-
-        float p25 = 0.0;
-        float p50 = 0.0;
-        float p75 = 0.0;
-
-        if(repetitions>=4){
-            p25 = th_collect[(repetitions/4)-1];
-            p50 = th_collect[(repetitions/2)-1];
-            p75 = th_collect[(repetitions*3)/4-1];
-        }
+            float min = th_collect[0];
+            float max = th_collect[repetitions-1];
+
+            float p25 = 0.0;
+            float p50 = 0.0;
+            float p75 = 0.0;
+
+            if(repetitions>=4){
+                p25 = th_collect[(repetitions/4)-1];
+                p50 = th_collect[(repetitions/2)-1];
+                p75 = th_collect[(repetitions*3)/4-1];
+            }
     
-        float p1  = 0.0;
-        float p5  = 0.0;
-        float p95 = 0.0;
-        float p99 = 0.0;
-        float iqr = p75 - p25;
+            float p1  = 0.0;
+            float p5  = 0.0;
+            float p95 = 0.0;
+            float p99 = 0.0;
+            float iqr = p75 - p25;
     
-        float lower_iqr = p25 - (1.5 * iqr);
-        float upper_iqr = p75 + (1.5 * iqr);
-        if (repetitions >= 100) {
-            p1  = th_collect[((repetitions)/100)-1];
-            p5  = th_collect[((repetitions*5)/100)-1];
-            p95 = th_collect[((repetitions*95)/100)-1];
-            p99 = th_collect[((repetitions*99)/100)-1];
-        }
+            float lower_iqr = p25 - (1.5 * iqr);
+            float upper_iqr = p75 + (1.5 * iqr);
+            if (repetitions >= 100) {
+                p1  = th_collect[((repetitions)/100)-1];
+                p5  = th_collect[((repetitions*5)/100)-1];
+                p95 = th_collect[((repetitions*95)/100)-1];
+                p99 = th_collect[((repetitions*99)/100)-1];
+            }
         
-        th_collect.clear();
-
-        std::fstream file;
-        std::string hash_name = name_of(hash);
-
-        if(i==0){
-            std::string name = "skt_results_collect_"+hash_name+".dat";
-            file.open (name, std::ios::app);         
-        }
-        else{
-            std::string name = "skt_results_total_"+hash_name+".dat";
-            file.open (name, std::ios::app);
-        }
-
-        file.seekg (0, std::ios::end);
-        int length = file.tellg();
-
-        if(length == 0)
-            file<<"items threads hpval arval apval crval cpval repet min max p1 p5 p25 p50 p75 p95 p99 iqr liqr uiqr hll agms"<<std::endl; 
+            th_collect.clear();
+
+            std::fstream file;
+            std::string hash_name = name_of(hash);
+            if(bm.name != name_of(collect_e::DIRECT))  hash_name = hash_name + "_" + bm.name;
+            if(layout != layout_e::ROWS)  hash_name = hash_name + "_" + name_of(layout);
+            if(key_bits != 32)  hash_name = hash_name + "_K" + (key_bits? std::to_string(key_bits) : "STR");
+            std::replace(hash_name.begin(), hash_name.end(), ':', '_');
+
+            if(i==0){
+                std::string name = "skt_results_collect_"+hash_name+".dat";
+                file.open (name, std::ios::app);         
+            }
+            else{
+                std::string name = "skt_results_total_"+hash_name+".dat";
+                file.open (name, std::ios::app);
+            }
+
+            file.seekg (0, std::ios::end);
+            int length = file.tellg();
+
+            if(length == 0)
+                file<<"items threads hpval arval apval crval cpval repet min max p1 p5 p25 p50 p75 p95 p99 iqr liqr uiqr hll f2"<<std::endl; 
     
-        file<< num_items <<" "<< num_threads <<" "
-            << hp_val <<" "<< ar_val <<" "<< ap_val <<" "<< cr_val <<" "<< cp_val <<" "
-            << repetitions <<" "<< std::setprecision(5) 
-            << min <<" "<< max <<" "
-            << p1 <<" "<< p5 <<" "<< p25 <<" "
-            << p50 <<" "<< p75 <<" "<< p95 <<" "<<p99<<" "
-            << iqr <<" "<< lower_iqr <<" "
-            << upper_iqr<<" "<<cardest<<" "<<median<<std::endl;
+            file<< num_items <<" "<< num_threads <<" "
+                << hp_val <<" "<< ar_val <<" "<< ap_val <<" "<< cr_val <<" "<< cp_val <<" "
+                << repetitions <<" "<< std::setprecision(5) 
+                << min <<" "<< max <<" "
+                << p1 <<" "<< p5 <<" "<< p25 <<" "
+                << p50 <<" "<< p75 <<" "<< p95 <<" "<<p99<<" "
+                << iqr <<" "<< lower_iqr <<" "
+                << upper_iqr<<" "<<cardest<<" "<<f2est<<std::endl;
     
-        file.close();
+            file.close();
+        }
     }
 
     return  0;
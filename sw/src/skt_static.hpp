@@ -0,0 +1,282 @@
+/**
+ * Copyright (c) 2020, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SKT_STATIC_HPP
+#define SKT_STATIC_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "skt.hpp"
+
+// Compile-time composed sketch sets: Skt<HASH, Hll<14>, Cm<5,13>> hashes each
+// key once and updates only the listed sketches, with their geometry as
+// constants. A sketch is a policy class that
+//  - is constructible from the hash word width in bits,
+//  - has template<typename T> void update(T const *hashv, size_t cnt) over a tile of hash words,
+//  - has merge(other) and clean(),
+// and brings its own estimators. Hll, Agms and Cm use the hash bits as
+// SktCollector does with layout_e::ROWS, so equal geometries fill equal tables.
+// The tables are members: allocate large sets on the heap, where Skt keeps
+// them cache-line aligned.
+
+template<unsigned P>
+class Hll {
+    static_assert((4 <= P) && (P <= 24), "HLL precision out of bounds.");
+    unsigned const              m_q;
+
+public:
+    static size_t constexpr  SIZE = size_t(1) << P;
+    alignas(64) uint8_t         regs[SIZE];
+
+    explicit Hll(unsigned const  hash_bits) : m_q(hash_bits - P) { clean(); }
+
+    template<typename T>
+    void update(T const *hashv, size_t const  cnt) {
+        unsigned constexpr  REST = 8*sizeof(T) - P;
+        for(size_t i = 0; i < cnt; i++) {
+            T const  h = hashv[i];
+            uint8_t       &reg  = regs[h >> REST];
+            unsigned const rank = clz_nz(((h+1)<<P)-1) + 1;
+            if(rank > reg)  reg = rank;
+        }
+    }
+    void merge(Hll const &other) {
+        for(size_t i = 0; i < SIZE; i++)  regs[i] = std::max(regs[i], other.regs[i]);
+    }
+    void clean() { memset(regs, 0, SIZE); }
+
+    double estimate_cardinality() const {
+        uint32_t  hist[256] = { 0, };
+        for(size_t i = 0; i < SIZE; i++)  hist[regs[i]]++;
+        return  skt_hll_estimate(hist, P, m_q);
+    }
+};
+
+template<unsigned R, unsigned P>
+class Agms {
+    static_assert((R > 0) && (R <= SKT_MAX_ROWS) && (P > 0), "AGMS geometry out of bounds.");
+
+    // Median over the rows of sum_i a[i]*b[i]
+    static double median_product(signed const *a, signed const *b) {
+        int64_t  sums[R];
+        for(unsigned j = 0; j < R; j++) {
+            sums[j] = 0;
+            for(size_t i = 0; i < (size_t(1) << P); i++)  sums[j] += (int64_t)a[(j << P) + i] * b[(j << P) + i];
+        }
+        std::sort(sums, sums+R);
+        return  (double(sums[(R-1)/2]) + double(sums[R/2]))/2;
+    }
+
+public:
+    static size_t constexpr  SIZE = size_t(R) << P;
+    alignas(64) signed          ctr[SIZE];
+
+    explicit Agms(unsigned) { clean(); }
+
+    // Row j takes its slot from hash bits j*(P+1) and its sign from the bit above
+    template<typename T>
+    void update(T const *hashv, size_t const  cnt) {
+        for(unsigned j = 0; j < R; j++) {
+            signed  *const  row   = &ctr[(size_t)j << P];
+            unsigned const  shift = j*(P+1);
+            if(shift >= 8*sizeof(T)) {
+                row[0] -= (signed)cnt;
+                continue;
+            }
+            for(size_t i = 0; i < cnt; i++) {
+                T const  v = hashv[i] >> shift;
+                row[(uint32_t)v & ((UINT32_C(1) << P)-1)] += (signed)((uint32_t)(v >> (P-1)) & 2) - 1;
+            }
+        }
+    }
+    void merge(Agms const &other) {
+        for(size_t i = 0; i < SIZE; i++)  ctr[i] += other.ctr[i];
+    }
+    void clean() { memset(ctr, 0, sizeof(ctr)); }
+
+    double estimate_f2() const { return  median_product(ctr, ctr); }
+    double estimate_inner_product(Agms const &other) const { return  median_product(ctr, other.ctr); }
+
+    // Median of the signed counters of hash word h
+    template<typename T>
+    double frequency(T const  h) const {
+        signed  vals[R];
+        for(unsigned j = 0; j < R; j++) {
+            unsigned const  shift = j*(P+1);
+            T const  v = (shift < 8*sizeof(T))? h >> shift : 0;
+            vals[j] = ctr[((size_t)j << P) + ((uint32_t)v & ((UINT32_C(1) << P)-1))] * ((signed)((uint32_t)(v >> (P-1)) & 2) - 1);
+        }
+        std::sort(vals, vals+R);
+        return  (double(vals[(R-1)/2]) + double(vals[R/2]))/2;
+    }
+};
+
+template<unsigned R, unsigned P>
+class Cm {
+    static_assert((R > 0) && (R <= SKT_MAX_ROWS) && (P > 0), "CM geometry out of bounds.");
+
+public:
+    static size_t constexpr  SIZE = size_t(R) << P;
+    alignas(64) unsigned        ctr[SIZE];
+
+    explicit Cm(unsigned) { clean(); }
+
+    // Row j takes its slot from hash bits j*P
+    template<typename T>
+    void update(T const *hashv, size_t const  cnt) {
+        for(unsigned j = 0; j < R; j++) {
+            unsigned *const  row   = &ctr[(size_t)j << P];
+            unsigned  const  shift = j*P;
+            if(shift >= 8*sizeof(T)) {
+                row[0] += (unsigned)cnt;
+                continue;
+            }
+            for(size_t i = 0; i < cnt; i++)  row[(uint32_t)(hashv[i] >> shift) & ((UINT32_C(1) << P)-1)]++;
+        }
+    }
+    void merge(Cm const &other) {
+        for(size_t i = 0; i < SIZE; i++)  ctr[i] += other.ctr[i];
+    }
+    void clean() { memset(ctr, 0, sizeof(ctr)); }
+
+    // Minimum over the rows of hash word h
+    template<typename T>
+    unsigned frequency(T const  h) const {
+        unsigned  res = ~0u;
+        for(unsigned j = 0; j < R; j++) {
+            unsigned const  shift = j*P;
+            uint32_t const  t = (shift < 8*sizeof(T))? (uint32_t)(h >> shift) & ((UINT32_C(1) << P)-1) : 0;
+            res = std::min(res, ctr[((size_t)j << P) + t]);
+        }
+        return  res;
+    }
+};
+
+// Whether X occurs among S
+template<typename X, typename... S>
+struct skt_contains : std::false_type {};
+template<typename X, typename Y, typename... S>
+struct skt_contains<X, Y, S...> : std::integral_constant<bool, std::is_same<X, Y>::value || skt_contains<X, S...>::value> {};
+
+// Whether no type occurs twice among S
+template<typename... S>
+struct skt_distinct : std::true_type {};
+template<typename X, typename... S>
+struct skt_distinct<X, S...> : std::integral_constant<bool, !skt_contains<X, S...>::value && skt_distinct<S...>::value> {};
+
+template<hash_e HASH, typename... S>
+class Skt {
+    static_assert(skt_distinct<S...>::value, "Skt lists a sketch twice, get<X>() could not tell them apart.");
+
+public:
+    typedef typename skt_word<HASH>::type  word_t;
+    static unsigned constexpr  HASH_BITS = 8*sizeof(word_t);
+    static size_t   constexpr  TILE = 512;
+
+private:
+    std::tuple<S...>            m_sketches;
+
+    template<typename>
+    static constexpr unsigned hash_bits() { return  HASH_BITS; }
+
+    template<size_t... I>
+    void update(word_t const *hashv, size_t const  cnt, std::index_sequence<I...>) {
+        int const  expand[] = { 0, (std::get<I>(m_sketches).update(hashv, cnt), 0)... };
+        (void)expand;
+    }
+    template<size_t... I>
+    void merge(Skt const &other, std::index_sequence<I...>) {
+        int const  expand[] = { 0, (std::get<I>(m_sketches).merge(std::get<I>(other.m_sketches)), 0)... };
+        (void)expand;
+    }
+    template<size_t... I>
+    void clean(std::index_sequence<I...>) {
+        int const  expand[] = { 0, (std::get<I>(m_sketches).clean(), 0)... };
+        (void)expand;
+    }
+
+    template<typename D>
+    void collect0(D const data, size_t const  n) {
+        alignas(64) word_t  hashv[TILE];
+        for(size_t ofs = 0; ofs < n; ofs += TILE) {
+            size_t const  cnt = std::min(n-ofs, TILE);
+            skt_hash_ptr<HASH>(data+ofs, cnt, hashv);
+            update(hashv, cnt, std::index_sequence_for<S...>());
+        }
+    }
+
+public:
+    Skt() : m_sketches(hash_bits<S>()...) {}
+
+    // Plain new only aligns to alignof(max_align_t) before C++17
+    static void* operator new(size_t const  bytes) {
+        if(void *const  p = aligned_alloc(64, (bytes + 63) & ~size_t(63)))  return  p;
+        throw  std::bad_alloc();
+    }
+    static void operator delete(void *p) { free(p); }
+
+public:
+    // 32-bit, 64-bit or string keys, hashed once per tile for all sketches
+    template<typename K>
+    void collect(K const *data, size_t const  n) { collect0(data, n); }
+    void collect(skt_strings_t const keys, size_t const  n) { collect0(keys, n); }
+
+    Skt& merge(Skt const &other) {
+        merge(other, std::index_sequence_for<S...>());
+        return  *this;
+    }
+    void clean() { clean(std::index_sequence_for<S...>()); }
+
+    // The sketch of type X, e.g. get<Hll<14>>().estimate_cardinality()
+    template<typename X>
+    X& get() { return  std::get<X>(m_sketches); }
+    template<typename X>
+    X const& get() const { return  std::get<X>(m_sketches); }
+
+    // Point frequency of a key in sketch X (Agms or Cm)
+    template<typename X, typename K>
+    auto frequency(K const  key) const -> decltype(std::declval<X const&>().frequency(word_t())) {
+        word_t  h;
+        skt_hash_ptr<HASH>(&key, 1, &h);
+        return  get<X>().frequency(h);
+    }
+};
+
+template<hash_e HASH, typename... S>
+size_t constexpr  Skt<HASH, S...>::TILE;
+
+// The trio of SktCollector with layout_e::ROWS, fixed at compile time
+template<hash_e HASH, unsigned HP, unsigned AR, unsigned AP, unsigned CR, unsigned CP>
+using SktTrio = Skt<HASH, Hll<HP>, Agms<AR, AP>, Cm<CR, CP>>;
+
+#endif
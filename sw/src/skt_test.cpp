@@ -0,0 +1,732 @@
+/**
+ * Copyright (c) 2020, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <memory>
+#include <map>
+#include <functional>
+#include <algorithm>
+#include <thread>
+#include <cstring>
+#include <cmath>
+
+#include "skt.hpp"
+#include "skt_static.hpp"
+
+// Behavioral tests, each run by name: sketch_test <test>, or all without one.
+// A test returns the number of failed checks.
+
+#define CHECK(...) \
+    do { if(!(__VA_ARGS__)) { std::cerr << __FILE__ << ':' << __LINE__ << ": " #__VA_ARGS__ << std::endl; fails++; } } while(0)
+
+static std::vector<uint32_t> keys32(size_t const  n, uint32_t const  range, unsigned const  seed) {
+    std::mt19937  rng(seed);
+    std::vector<uint32_t>  keys(n);
+    for(uint32_t &k : keys)  k = rng() % range;
+    return  keys;
+}
+
+static std::vector<uint64_t> keys64(size_t const  n, unsigned const  seed) {
+    std::mt19937_64  rng(seed);
+    std::vector<uint64_t>  keys(n);
+    for(uint64_t &k : keys)  k = rng() >> (rng() % 48);    // some keys repeat
+    return  keys;
+}
+
+// Decimal forms of keys as an arena, see skt_strings_t
+struct strings_t {
+    std::string            bytes;
+    std::vector<uint64_t>  offs;
+
+    explicit strings_t(std::vector<uint32_t> const &keys) : offs(1, 0) {
+        for(uint32_t const  k : keys) {
+            bytes += std::to_string(k);
+            offs.push_back(bytes.size());
+        }
+    }
+    skt_strings_t get() const { return  skt_strings_t { (uint8_t const*)bytes.data(), offs.data() }; }
+};
+
+// What a collector answers about a set of probe keys. Equal sketches answer
+// alike whatever their collect mode or table layout.
+struct answers_t {
+    double                 card;
+    double                 f2;
+    std::vector<unsigned>  cm;
+    std::vector<double>    agms;
+
+    answers_t(SktCollector &c, std::vector<uint32_t> const &probe)
+     : card(c.estimate_cardinality()), f2(c.estimate_f2()), cm(probe.size()), agms(probe.size()) {
+        c.query_frequency(probe.data(), probe.size(), cm.data(), agms.data());
+    }
+    bool operator==(answers_t const &o) const { return  (card == o.card) && (f2 == o.f2) && (cm == o.cm) && (agms == o.agms); }
+};
+
+// Every collect mode against DIRECT under each table layout (LINES picks other
+// slots than ROWS), for all key kinds, for a generic geometry, a specialized
+// one and one large enough for RADIX
+static unsigned test_modes() {
+    unsigned  fails = 0;
+    struct { unsigned  hp, ar, ap, cr, cp; } const  GEOMETRIES[] = { { 10, 3, 9, 4, 10 }, { 13, 5, 13, 5, 13 }, { 12, 2, 17, 2, 17 } };
+    std::vector<uint32_t> const  keys  = keys32(20000, 5000, 2);
+    std::vector<uint32_t> const  probe(keys.begin(), keys.begin()+100);
+    std::vector<uint64_t> const  wide  = keys64(20000, 3);
+    strings_t const              str(keys);
+
+    std::map<uint32_t, unsigned>  count;
+    for(uint32_t const  k : keys)  count[k]++;
+
+    for(auto const &g : GEOMETRIES) {
+        for(unsigned h = 0; h < (unsigned)hash_e::end; h++) {
+            hash_e const  hash = (hash_e)h;
+            auto const  fill = [&](SktCollector &c, int const  kind) {
+                if(kind == 0)       c.collect(keys.data(), keys.size());
+                else if(kind == 1)  c.collect(wide.data(), wide.size());
+                else                c.collect(str.get(), keys.size());
+            };
+            for(int kind = 0; kind < 3; kind++) {
+                if((kind == 2) && (hash == hash_e::IDENT))  continue;
+                for(unsigned l = 0; l < (unsigned)layout_e::end; l++) {
+                    layout_e const  layout = (layout_e)l;
+                    SktCollector  ref(g.hp, g.ar, g.ap, g.cr, g.cp, hash, collect_e::DIRECT, layout);
+                    fill(ref, kind);
+                    answers_t const  expect(ref, probe);
+
+                    for(unsigned m = 1; m < (unsigned)collect_e::end; m++) {
+                        collect_e const  mode = (collect_e)m;
+                        SktCollector  c(g.hp, g.ar, g.ap, g.cr, g.cp, hash, mode, layout);
+                        fill(c, kind);
+                        answers_t const  got(c, probe);
+                        if(mode != collect_e::CONSERVATIVE) {
+                            CHECK(got == expect);
+                            continue;
+                        }
+                        // Conservative CM never undercounts and never exceeds plain CM
+                        CHECK((got.card == expect.card) && (got.f2 == expect.f2) && (got.agms == expect.agms));
+                        for(size_t i = 0; i < probe.size(); i++) {
+                            CHECK(got.cm[i] <= expect.cm[i]);
+                            if(kind == 0)  CHECK(got.cm[i] >= count[probe[i]]);
+                        }
+                    }
+
+                    // Partitioned by threads, with fixed-width keys only
+                    if(kind == 2)  continue;
+                    SktCollector  c(g.hp, g.ar, g.ap, g.cr, g.cp, hash, collect_e::PARTITIONED, layout);
+                    if(kind == 0)  c.collect_partitioned(keys.data(), keys.size(), 3);
+                    else           c.collect_partitioned(wide.data(), wide.size(), 3);
+                    CHECK(answers_t(c, probe) == expect);
+                }
+            }
+        }
+    }
+    return  fails;
+}
+
+// Ertl's estimator stays within a few standard errors (1.04/sqrt(M)) of the
+// true count from a handful of keys to far past M, without a bias bump at
+// the switch from linear counting
+static unsigned test_estimate() {
+    unsigned  fails = 0;
+    for(unsigned const  hp : { 8u, 11u, 14u }) {
+        double const  err = 1.04/std::sqrt(double(size_t(1) << hp));
+        for(hash_e const  hash : { hash_e::MURMUR3_32, hash_e::MURMUR3_64 }) {
+            SktCollector  c(hp, 1, 4, 1, 4, hash);
+            CHECK(c.estimate_cardinality() == 0.0);
+
+            // Adds the keys [lo, hi) and checks the estimate at each decade and its halves
+            std::vector<uint64_t>  keys;
+            uint64_t  lo = 0;
+            for(uint64_t const  n : { 5, 10, 50, 100, 500, 1000, 5000, 10000, 50000, 100000, 500000, 1000000 }) {
+                keys.clear();
+                for(uint64_t  k = lo; k < n; k++)  keys.push_back(k*UINT64_C(0x9E3779B97F4A7C15));
+                c.collect(keys.data(), keys.size());
+                lo = n;
+                double const  est = c.estimate_cardinality();
+                CHECK(std::abs(est - n) <= std::max(4*err*n, 1.0));
+            }
+        }
+    }
+    return  fails;
+}
+
+// F2 and the join size of two overlapping streams against their exact values,
+// within four standard errors of the AGMS row estimates
+static unsigned test_moments() {
+    unsigned  fails = 0;
+    unsigned const  ar = 7, ap = 12;
+    double   const  w  = double(size_t(1) << ap);
+
+    std::vector<uint32_t>  a = keys32(200000, 2000, 4);
+    std::vector<uint32_t>  b = keys32(100000, 3000, 5);
+    for(uint32_t &k : b)  k += 1000;
+    std::map<uint32_t, int64_t>  fa, fb;
+    for(uint32_t const  k : a)  fa[k]++;
+    for(uint32_t const  k : b)  fb[k]++;
+    double  f2a = 0, f2b = 0, join = 0;
+    for(auto const &e : fa)  f2a += double(e.second)*e.second;
+    for(auto const &e : fb) {
+        f2b += double(e.second)*e.second;
+        auto const  it = fa.find(e.first);
+        if(it != fa.end())  join += double(e.second)*it->second;
+    }
+
+    for(unsigned l = 0; l < (unsigned)layout_e::end; l++) {
+        SktCollector  ca(10, ar, ap, 1, 4, hash_e::MURMUR3_64, collect_e::BLOCKED, (layout_e)l);
+        SktCollector  cb(10, ar, ap, 1, 4, hash_e::MURMUR3_64, collect_e::BLOCKED, (layout_e)l);
+        ca.collect(a.data(), a.size());
+        cb.collect(b.data(), b.size());
+        CHECK(std::abs(ca.estimate_f2() - f2a) <= 4*std::sqrt(2/w)*f2a);
+        CHECK(std::abs(cb.estimate_f2() - f2b) <= 4*std::sqrt(2/w)*f2b);
+        CHECK(std::abs(ca.estimate_inner_product(cb) - join) <= 4*std::sqrt((f2a*f2b + join*join)/w));
+        CHECK(ca.estimate_inner_product(cb) == cb.estimate_inner_product(ca));
+        CHECK(ca.estimate_inner_product(ca) == ca.estimate_f2());
+    }
+
+    // Tables that do not line up cannot be joined
+    SktCollector  rows (10, ar, ap, 1, 4, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::ROWS);
+    SktCollector  lines(10, ar, ap, 1, 4, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::LINES);
+    SktCollector  small(10, ar, ap-1, 1, 4, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::ROWS);
+    SktCollector  none (10, 0, ap, 1, 4, hash_e::MURMUR3_64);
+    for(SktCollector const *o : { &lines, &small }) {
+        bool  thrown = false;
+        try { rows.estimate_inner_product(*o); } catch(std::invalid_argument const&) { thrown = true; }
+        CHECK(thrown);
+    }
+    bool  thrown = false;
+    try { none.estimate_f2(); } catch(std::invalid_argument const&) { thrown = true; }
+    CHECK(thrown);
+    return  fails;
+}
+
+// A weighted key counts like the key repeated, a negative weight takes back
+// earlier ones from CM and AGMS while HLL keeps what it saw
+static unsigned test_weighted() {
+    unsigned  fails = 0;
+    std::vector<uint32_t> const  keys = keys32(5000, 1000, 6);
+    std::vector<uint32_t> const  probe(keys.begin(), keys.begin()+50);
+    std::vector<int32_t>         weights(keys.size());
+    std::vector<uint32_t>        repeated;
+    std::mt19937  rng(7);
+    for(size_t i = 0; i < keys.size(); i++) {
+        weights[i] = 1 + rng() % 4;
+        repeated.insert(repeated.end(), weights[i], keys[i]);
+    }
+    strings_t const  str(keys), str_repeated(repeated);
+
+    // The second half of the keys taken back again
+    size_t const          half = keys.size()/2;
+    std::vector<int32_t>  minus(weights.begin()+half, weights.end());
+    for(int32_t &w : minus)  w = -w;
+
+    for(collect_e const  mode : { collect_e::DIRECT, collect_e::BLOCKED, collect_e::PREFETCH, collect_e::CONSERVATIVE, collect_e::ATOMIC }) {
+        for(unsigned l = 0; l < (unsigned)layout_e::end; l++) {
+            layout_e const  layout = (layout_e)l;
+            SktCollector  ref(10, 5, 9, 5, 9, hash_e::MURMUR3_64, mode, layout);
+            SktCollector  c  (10, 5, 9, 5, 9, hash_e::MURMUR3_64, mode, layout);
+            ref.collect(repeated.data(), repeated.size());
+            c.collect_weighted(keys.data(), weights.data(), keys.size());
+            CHECK(answers_t(c, probe) == answers_t(ref, probe));
+
+            SktCollector  ref_str(10, 5, 9, 5, 9, hash_e::MURMUR3_64, mode, layout);
+            SktCollector  c_str  (10, 5, 9, 5, 9, hash_e::MURMUR3_64, mode, layout);
+            ref_str.collect(str_repeated.get(), repeated.size());
+            c_str.collect_weighted(str.get(), weights.data(), keys.size());
+            CHECK(answers_t(c_str, probe) == answers_t(ref_str, probe));
+
+            if(mode == collect_e::CONSERVATIVE) {
+                bool  thrown = false;
+                try { c.collect_weighted(&keys[half], minus.data(), minus.size()); } catch(std::invalid_argument const&) { thrown = true; }
+                CHECK(thrown);
+                continue;
+            }
+            // Turnstile: CM and AGMS as if only the first half was seen, HLL as before
+            double const  card = c.estimate_cardinality();
+            c.collect_weighted(&keys[half], minus.data(), minus.size());
+            SktCollector  first(10, 5, 9, 5, 9, hash_e::MURMUR3_64, mode, layout);
+            first.collect_weighted(keys.data(), weights.data(), half);
+            answers_t  got(c, probe), expect(first, probe);
+            CHECK(got.card == card);
+            CHECK((got.f2 == expect.f2) && (got.cm == expect.cm) && (got.agms == expect.agms));
+        }
+    }
+
+    // Keys of zero weight are not seen at all
+    std::vector<int32_t> const  zero(keys.size(), 0);
+    SktCollector  z(10, 5, 9, 5, 9, hash_e::MURMUR3_64);
+    z.collect_weighted(keys.data(), zero.data(), keys.size());
+    CHECK((z.estimate_cardinality() == 0.0) && (z.estimate_f2() == 0.0));
+
+    // Weighted into a sparse HLL, folded into dense registers
+    SktCollector  d(12, 5, 9, 5, 9, hash_e::MURMUR3_64);
+    SktCollector  s(12, 5, 9, 5, 9, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::ROWS, true);
+    d.collect_weighted(keys.data(), weights.data(), 200);
+    s.collect_weighted(keys.data(), weights.data(), 200);
+    CHECK(s.sparse());
+    SktCollector  folded(12, 5, 9, 5, 9, hash_e::MURMUR3_64);
+    folded.merge(s);
+    CHECK(answers_t(folded, probe) == answers_t(d, probe));
+    return  fails;
+}
+
+// A collector of a subset of the sketches answers like the full collector
+// for the sketches it keeps, and rejects questions about the others, for a
+// generic and a specialized geometry in every collect mode
+static unsigned test_subsets() {
+    unsigned  fails = 0;
+    struct { unsigned  hp, ar, ap, cr, cp; } const  GEOMETRIES[] = { { 10, 3, 9, 4, 10 }, { 13, 5, 13, 5, 13 } };
+    std::vector<uint32_t> const  keys = keys32(30000, 8000, 14);
+    std::vector<uint32_t> const  probe(keys.begin(), keys.begin()+50);
+    for(auto const &g : GEOMETRIES) {
+        for(unsigned m = 0; m < (unsigned)collect_e::end; m++) {
+            collect_e const  mode = (collect_e)m;
+            SktCollector  full(g.hp, g.ar, g.ap, g.cr, g.cp, hash_e::MURMUR3_64, mode);
+            SktCollector  hll (g.hp, g.ar, g.ap, g.cr, g.cp, hash_e::MURMUR3_64, mode, layout_e::ROWS, false, pages_e::THP, SKT_HLL);
+            SktCollector  tab (g.hp, g.ar, g.ap, g.cr, g.cp, hash_e::MURMUR3_64, mode, layout_e::ROWS, false, pages_e::THP, SKT_AGMS | SKT_CM);
+            SktCollector  cm  (g.hp, g.ar, g.ap, g.cr, g.cp, hash_e::MURMUR3_64, mode, layout_e::ROWS, false, pages_e::THP, SKT_CM);
+            for(SktCollector *c : { &full, &hll, &tab, &cm })  c->collect(keys.data(), keys.size());
+            CHECK(hll.sketches() == SKT_HLL);
+            CHECK(tab.sketches() == (SKT_AGMS | SKT_CM));
+            CHECK(cm.sketches() == SKT_CM);
+
+            answers_t const  ref(full, probe);
+            CHECK(hll.estimate_cardinality() == ref.card);
+            CHECK(tab.estimate_f2() == ref.f2);
+            std::vector<unsigned>  cm_out(probe.size());
+            std::vector<double>    agms_out(probe.size());
+            tab.query_frequency(probe.data(), probe.size(), cm_out.data(), agms_out.data());
+            CHECK((cm_out == ref.cm) && (agms_out == ref.agms));
+            std::fill(cm_out.begin(), cm_out.end(), 0);
+            cm.query_frequency(probe.data(), probe.size(), cm_out.data());
+            CHECK(cm_out == ref.cm);
+
+            auto const  rejects = [&](std::function<void()> const &f) {
+                try { f(); } catch(std::invalid_argument const&) { return  true; }
+                return  false;
+            };
+            CHECK(rejects([&]() { hll.estimate_f2(); }));
+            CHECK(rejects([&]() { hll.query_frequency(probe.data(), probe.size(), cm_out.data()); }));
+            CHECK(rejects([&]() { tab.estimate_cardinality(); }));
+            CHECK(rejects([&]() { cm.estimate_cardinality(); }));
+            CHECK(rejects([&]() { cm.estimate_f2(); }));
+            CHECK(rejects([&]() { cm.estimate_inner_product(tab); }));
+            CHECK(rejects([&]() { cm.query_frequency(probe.data(), probe.size(), cm_out.data(), agms_out.data()); }));
+            CHECK(rejects([&]() { full.merge(hll); }));
+        }
+    }
+
+    // HLL-only collectors of a fixed geometry get a specialized backend whatever their table widths
+    CHECK(skt_collect_fixed_ptr(hash_e::MURMUR3_64, collect_e::BLOCKED, 13, 0, 13, 0, 13) != nullptr);
+    CHECK(skt_collect_fixed64_ptr(hash_e::MURMUR3_64, collect_e::DIRECT, 16, 0, 9, 0, 9) != nullptr);
+    CHECK(skt_collect_fixed_ptr(hash_e::MURMUR3_64, collect_e::ATOMIC, 13, 5, 13, 5, 13) == nullptr);
+    return  fails;
+}
+
+// Feeds groups interleaved in batches: most get a few keys, every 40th one
+// more than small. Small groups are answered exactly, promoted ones like a
+// sparse collector fed the same keys.
+template<typename K>
+static unsigned check_groups(unsigned const  num_groups, unsigned const  seed, size_t *arena) {
+    unsigned  fails = 0;
+    unsigned const  SMALL = 256;
+    std::mt19937  rng(seed);
+    std::map<uint32_t, std::vector<K>>  ref;
+    std::vector<std::pair<uint32_t, K>>  items;
+    for(unsigned g = 0; g < num_groups; g++) {
+        uint32_t const  id = rng();
+        size_t const  cnt = (g % 40 == 0)? 300 + rng() % 3000 : 1 + rng() % 60;
+        for(size_t i = 0; i < cnt; i++) {
+            K const  key = (K)(rng() % (2*cnt)) << (8*sizeof(K) - 32);
+            ref[id].push_back(key);
+            items.emplace_back(id, key);
+        }
+    }
+    std::shuffle(items.begin(), items.end(), rng);
+
+    SktGroups<K>  groups(12, 3, 9, 3, 9, hash_e::MURMUR3_64, SMALL, collect_e::BLOCKED);
+    std::vector<uint32_t>  ids;
+    std::vector<K>         keys;
+    for(size_t ofs = 0; ofs < items.size(); ofs += 1000) {
+        ids.clear();
+        keys.clear();
+        for(size_t i = ofs; i < std::min(ofs+1000, items.size()); i++) {
+            ids.push_back(items[i].first);
+            keys.push_back(items[i].second);
+        }
+        groups.collect(ids.data(), keys.data(), ids.size());
+    }
+    CHECK(groups.size() == ref.size());
+
+    size_t  promoted = 0, small_keys = 0;
+    for(auto &r : ref) {
+        std::vector<K> const &v = r.second;
+        std::vector<K> const  probe(v.begin(), v.begin() + std::min<size_t>(v.size(), 8));
+        std::vector<unsigned>  cm(probe.size()), cm_ref(probe.size());
+        groups.query_frequency(r.first, probe.data(), probe.size(), cm.data());
+        if(v.size() > SMALL) {
+            promoted++;
+            SktCollector  c(12, 3, 9, 3, 9, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::ROWS, true);
+            c.collect(v.data(), v.size());
+            c.query_frequency(probe.data(), probe.size(), cm_ref.data());
+            CHECK(groups.estimate_cardinality(r.first) == c.estimate_cardinality());
+            CHECK(groups.estimate_f2(r.first) == c.estimate_f2());
+        }
+        else {
+            small_keys += v.size();
+            std::map<K, unsigned>  count;
+            for(K const  k : v)  count[k]++;
+            double  f2 = 0.0;
+            for(auto const &c : count)  f2 += double(c.second) * c.second;
+            for(size_t i = 0; i < probe.size(); i++)  cm_ref[i] = count[probe[i]];
+            CHECK(groups.estimate_cardinality(r.first) == count.size());
+            CHECK(groups.estimate_f2(r.first) == f2);
+        }
+        CHECK(cm == cm_ref);
+    }
+    CHECK(groups.promoted() == promoted);
+
+    // Chunks at most double the keys they hold, a promoted group's chunk is recycled
+    CHECK(groups.arena_size() <= 4*small_keys);
+    *arena = groups.arena_size();
+
+    // Unknown groups are empty
+    uint32_t  unknown = 0;
+    while(ref.count(unknown))  unknown++;
+    unsigned  none = 1;
+    K const   key  = 0;
+    groups.query_frequency(unknown, &key, 1, &none);
+    CHECK((groups.estimate_cardinality(unknown) == 0.0) && (groups.estimate_f2(unknown) == 0.0) && (none == 0));
+    return  fails;
+}
+
+// Memory follows the groups seen: four times the groups, about four times the arena
+static unsigned test_groups() {
+    unsigned  fails = 0;
+    size_t  arena[2];
+    fails += check_groups<uint32_t>(1000, 11, &arena[0]);
+    fails += check_groups<uint32_t>(4000, 12, &arena[1]);
+    CHECK((arena[1] > 3*arena[0]) && (arena[1] < 5*arena[0]));
+    fails += check_groups<uint64_t>(4000, 13, &arena[1]);
+    return  fails;
+}
+
+// Threads sharing one ATOMIC collector over disjoint slices of the input
+// leave it as DIRECT leaves a collector fed the whole input. Few distinct
+// keys and small tables make the threads race on the same registers.
+static unsigned test_atomic() {
+    unsigned  fails = 0;
+    unsigned const  T = 8;
+    for(uint32_t const  range : { 64u, 1u << 20 }) {
+        std::vector<uint32_t> const  keys = keys32(200000, range, range);
+        std::vector<uint64_t> const  wide = keys64(200000, range);
+        std::vector<int32_t>  weights(keys.size());
+        std::mt19937  rng(range);
+        for(int32_t &w : weights)  w = (int32_t)(rng() % 9) - 3;
+        std::vector<uint32_t> const  probe(keys.begin(), keys.begin()+50);
+
+        for(unsigned l = 0; l < (unsigned)layout_e::end; l++) {
+            layout_e const  layout = (layout_e)l;
+            for(int const  kind : { 0, 1, 2 }) {
+                SktCollector  shared(8, 3, 6, 3, 6, hash_e::MURMUR3_64, collect_e::ATOMIC, layout);
+                SktCollector  ref   (8, 3, 6, 3, 6, hash_e::MURMUR3_64, collect_e::DIRECT, layout);
+                std::vector<std::thread>  threads;
+                for(unsigned t = 0; t < T; t++)  threads.emplace_back([&, t]() {
+                    size_t const  hi = ((t+1)*keys.size())/T;
+                    for(size_t ofs = (t*keys.size())/T; ofs < hi; ofs += 97) {
+                        size_t const  cnt = std::min<size_t>(97, hi-ofs);
+                        if(kind == 0)       shared.collect(&keys[ofs], cnt);
+                        else if(kind == 1)  shared.collect(&wide[ofs], cnt);
+                        else                shared.collect_weighted(&keys[ofs], &weights[ofs], cnt);
+                    }
+                });
+                for(std::thread &t : threads)  t.join();
+                if(kind == 0)       ref.collect(keys.data(), keys.size());
+                else if(kind == 1)  ref.collect(wide.data(), wide.size());
+                else                ref.collect_weighted(keys.data(), weights.data(), keys.size());
+                CHECK(answers_t(shared, probe) == answers_t(ref, probe));
+            }
+        }
+    }
+    return  fails;
+}
+
+// A tree merge gives the collector a sequential merge() gives, at any count
+// and thread count, over a mix of sparse and dense inputs
+static unsigned test_merge() {
+    unsigned  fails = 0;
+    std::vector<uint32_t> const  probe = keys32(50, 1u << 14, 10);
+    for(size_t const  n : { size_t(1), size_t(2), size_t(3), size_t(7), size_t(64) }) {
+        for(unsigned const  threads : { 1u, 3u, 8u }) {
+            for(unsigned const  sparse_every : { 1u, 2u }) {
+                // Every sparse_every-th input dense, the others sparse; small
+                // sparse inputs stay sparse, larger ones densify on the way
+                auto const  build = [&](std::vector<SktCollector> &v) {
+                    for(size_t i = 0; i < n; i++) {
+                        bool const  sparse = (sparse_every == 1) || (i % sparse_every);
+                        v.emplace_back(12, 3, 9, 3, 9, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::ROWS, sparse);
+                        std::vector<uint32_t> const  keys = keys32((i % 5 == 4)? 2000 : 20 + 3*i, 1u << 14, 100*n + i);
+                        v.back().collect(keys.data(), keys.size());
+                    }
+                };
+                std::vector<SktCollector>  seq, tree;
+                build(seq);
+                build(tree);
+                for(size_t i = 1; i < n; i++)  seq[0].merge(seq[i]);
+                SktCollector::merge_tree(tree.data(), n, threads);
+                CHECK(tree[0].sparse() == seq[0].sparse());
+                CHECK(answers_t(tree[0], probe) == answers_t(seq[0], probe));
+            }
+        }
+    }
+    return  fails;
+}
+
+// A window snapshot over span ticks answers like a collector fed only the
+// items of those ticks, across repeated ticks and jumps past the window
+static unsigned test_window() {
+    unsigned  fails = 0;
+    unsigned const  W = 5;
+    std::mt19937  rng(8);
+    std::vector<std::vector<uint32_t>>  data(30);
+    for(size_t i = 0; i < data.size(); i++)  data[i] = keys32(1000 + rng() % 3000, 1u << (8 + i % 16), i);
+
+    for(hash_e const  hash : { hash_e::MURMUR3_32, hash_e::MURMUR3_64 }) {
+        for(unsigned l = 0; l < (unsigned)layout_e::end; l++) {
+            layout_e const  layout = (layout_e)l;
+            SktWindow  w(11, 4, 10, 4, 10, hash, W, layout);
+            SktWindow  w_hll(11, 0, 10, 0, 10, hash, W, layout);     // no ring
+            std::vector<uint64_t>  ticks;
+            uint64_t  t = 0;
+            for(size_t i = 0; i < data.size(); i++) {
+                t += (i % 7 == 6)? W+1 : (i % 3 == 2)? 0 : 1;
+                w.advance(t);
+                w_hll.advance(t);
+                ticks.push_back(t);
+                w.collect(data[i].data(), data[i].size());
+                w_hll.collect(data[i].data(), data[i].size());
+
+                for(unsigned span = 1; span <= W; span++) {
+                    SktCollector  ref(11, 4, 10, 4, 10, hash, collect_e::BLOCKED, layout);
+                    for(size_t j = 0; j <= i; j++) {
+                        if(ticks[j] + span > t)  ref.collect(data[j].data(), data[j].size());
+                    }
+                    std::vector<uint32_t> const  probe(data[i].begin(), data[i].begin()+20);
+                    SktCollector  snap = w.snapshot(span);
+                    CHECK(answers_t(snap, probe) == answers_t(ref, probe));
+                    CHECK(w_hll.snapshot(span).estimate_cardinality() == ref.estimate_cardinality());
+                }
+            }
+        }
+    }
+
+    bool  thrown[3] = { false, false, false };
+    try { SktWindow(11, 4, 10, 4, 10, hash_e::MURMUR3_64, 0); } catch(std::invalid_argument const&) { thrown[0] = true; }
+    try { SktWindow(0, 4, 10, 4, 10, hash_e::MURMUR3_64, W); } catch(std::invalid_argument const&) { thrown[1] = true; }
+    try { SktWindow(11, 4, 10, 4, 10, hash_e::MURMUR3_64, W).snapshot(W+1); } catch(std::invalid_argument const&) { thrown[2] = true; }
+    CHECK(thrown[0] && thrown[1] && thrown[2]);
+    return  fails;
+}
+
+// A store query answers like a collector fed the items of the ticks it
+// covers. Each level but the top holds the ticks from the start of the
+// previous parent interval, the top its last retain closed intervals, and a
+// tick is covered at the finest level still holding it: its whole interval
+// there is in the answer as soon as part of it is asked for.
+static unsigned test_store() {
+    unsigned  fails = 0;
+    std::vector<unsigned> const  fanout = { 4, 3 };
+    std::vector<uint64_t> const  len = { 1, 4, 12 };
+    unsigned const  retain = 3;
+    std::mt19937  rng(9);
+
+    for(unsigned l = 0; l < (unsigned)layout_e::end; l++) {
+        layout_e const  layout = (layout_e)l;
+        SktStore  store(10, 3, 9, 3, 9, hash_e::MURMUR3_64, fanout, retain, collect_e::DIRECT, layout);
+        std::vector<std::pair<uint64_t, std::vector<uint32_t>>>  data;
+        uint64_t  t = 0;
+        while(t < 120) {
+            for(unsigned b = rng() % 3; b > 0; b--) {
+                data.emplace_back(t, keys32(100 + rng() % 400, 1u << (6 + rng() % 12), data.size()));
+                store.current().collect(data.back().second.data(), data.back().second.size());
+            }
+
+            uint64_t  held[3];
+            for(unsigned k = 0; k < 2; k++)  held[k] = (t >= len[k+1])? (t/len[k+1] - 1) * len[k+1] : 0;
+            held[2] = (t/len[2] > retain)? (t/len[2] - retain) * len[2] : 0;
+
+            for(unsigned q = 0; q < 12; q++) {
+                uint64_t const  from = rng() % (t+1);
+                uint64_t const  to   = from + 1 + rng() % (t+2 - from);
+                uint64_t const  lo = std::max(from, held[2]);
+                uint64_t const  hi = std::min(to, t+1);
+
+                SktCollector  ref(10, 3, 9, 3, 9, hash_e::MURMUR3_64, collect_e::DIRECT, layout);
+                for(auto const &d : data) {
+                    if(d.first < held[2])  continue;
+                    unsigned  k = 0;
+                    while(d.first < held[k])  k++;
+                    uint64_t const  g = d.first / len[k] * len[k];
+                    if((g < hi) && (lo < g + len[k]))  ref.collect(d.second.data(), d.second.size());
+                }
+                std::vector<uint32_t> const  probe = keys32(20, 1u << 12, q);
+                SktCollector  res = store.query(from, to);
+                CHECK(answers_t(res, probe) == answers_t(ref, probe));
+                store.release(std::move(res));
+            }
+
+            t += (rng() % 9 == 0)? 5 + rng() % 20 : 1;
+            store.advance(t);
+        }
+    }
+
+    bool  thrown[3] = { false, false, false };
+    SktStore  store(10, 3, 9, 3, 9, hash_e::MURMUR3_64, fanout, retain);
+    try { store.query(5, 5); } catch(std::invalid_argument const&) { thrown[0] = true; }
+    try { SktStore(10, 3, 9, 3, 9, hash_e::MURMUR3_64, { 4, 1 }, retain); } catch(std::invalid_argument const&) { thrown[1] = true; }
+    try { SktStore(10, 3, 9, 3, 9, hash_e::MURMUR3_64, fanout, 0); } catch(std::invalid_argument const&) { thrown[2] = true; }
+    CHECK(thrown[0] && thrown[1] && thrown[2]);
+    return  fails;
+}
+
+// A sparse HLL answers like a dense one once folded into dense registers,
+// by merge or by outgrowing the sparse set, and estimates well while sparse
+static unsigned test_sparse() {
+    unsigned  fails = 0;
+    for(unsigned const  hp : { 8u, 12u, 16u }) {
+        size_t const  M = size_t(1) << hp;
+        for(size_t const  batch : { size_t(1), size_t(100), size_t(5000) }) {
+            // Past M/16 distinct keys the sparse set densifies, at any batch size
+            std::vector<uint32_t> const  keys = keys32(M/4, ~0u, hp);
+            std::vector<uint32_t> const  probe(keys.begin(), keys.begin()+16);
+            SktCollector  d(hp, 3, 8, 3, 8, hash_e::MURMUR3_64);
+            SktCollector  s(hp, 3, 8, 3, 8, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::ROWS, true);
+            CHECK(s.sparse());
+            for(size_t ofs = 0; ofs < keys.size(); ofs += batch) {
+                d.collect(&keys[ofs], std::min(batch, keys.size()-ofs));
+                s.collect(&keys[ofs], std::min(batch, keys.size()-ofs));
+            }
+            CHECK(!s.sparse());
+            CHECK(answers_t(s, probe) == answers_t(d, probe));
+        }
+
+        // Below the bound: sparse estimates, a dense merge target and sparse merges
+        std::vector<uint32_t> const  keys = keys32(M/32, ~0u, hp+1);
+        std::vector<uint32_t> const  probe(keys.begin(), keys.begin()+16);
+        size_t const  half = keys.size()/2;
+        SktCollector  d(hp, 3, 8, 3, 8, hash_e::MURMUR3_64);
+        SktCollector  a(hp, 3, 8, 3, 8, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::ROWS, true);
+        SktCollector  b(hp, 3, 8, 3, 8, hash_e::MURMUR3_64, collect_e::BLOCKED, layout_e::ROWS, true);
+        d.collect(keys.data(), keys.size());
+        a.collect(keys.data(), half);
+        b.collect(keys.data()+half, keys.size()-half);
+        CHECK(a.sparse() && b.sparse());
+        CHECK(std::abs(a.estimate_cardinality() - half) < 0.02*half);
+        a.merge(b);
+        CHECK(a.sparse());
+        CHECK(std::abs(a.estimate_cardinality() - keys.size()) < 0.02*keys.size());
+
+        SktCollector  z(hp, 3, 8, 3, 8, hash_e::MURMUR3_64);
+        z.merge(a);
+        CHECK(answers_t(z, probe) == answers_t(d, probe));
+    }
+    return  fails;
+}
+
+// Skt and SktTrio fill the tables of a ROWS collector of the same geometry
+template<hash_e HASH>
+static unsigned test_static_hash() {
+    unsigned  fails = 0;
+    typedef SktTrio<HASH, 12, 5, 11, 4, 11>  trio_t;
+    std::vector<uint32_t> const  keys = keys32(100000, 20000, 1);
+
+    SktCollector            c(12, 5, 11, 4, 11, HASH, collect_e::BLOCKED, layout_e::ROWS);
+    std::unique_ptr<trio_t> s(new trio_t());
+    c.collect(keys.data(), keys.size());
+    s->collect(keys.data(), keys.size());
+    CHECK(c.estimate_cardinality() == s->template get<Hll<12>>().estimate_cardinality());
+    CHECK(c.estimate_f2() == s->template get<Agms<5, 11>>().estimate_f2());
+
+    unsigned  cm[16];
+    double    agms[16];
+    c.query_frequency(keys.data(), 16, cm, agms);
+    for(unsigned i = 0; i < 16; i++) {
+        CHECK(cm[i] == s->template frequency<Cm<4, 11>>(keys[i]));
+        CHECK(agms[i] == s->template frequency<Agms<5, 11>>(keys[i]));
+    }
+
+    // A partial set updates only its own sketches, and merges like the full one
+    std::unique_ptr<Skt<HASH, Cm<4, 11>, Hll<12>>>  p(new Skt<HASH, Cm<4, 11>, Hll<12>>());
+    p->collect(keys.data(), keys.size());
+    p->merge(*p);
+    s->merge(*s);
+    CHECK(p->template get<Hll<12>>().estimate_cardinality() == s->template get<Hll<12>>().estimate_cardinality());
+    CHECK(p->template frequency<Cm<4, 11>>(keys[0]) == s->template frequency<Cm<4, 11>>(keys[0]));
+    s->clean();
+    CHECK(s->template get<Hll<12>>().estimate_cardinality() == 0.0);
+    return  fails;
+}
+
+static unsigned test_static() {
+    return  test_static_hash<hash_e::MURMUR3_32>() + test_static_hash<hash_e::MURMUR3_64>() + test_static_hash<hash_e::MURMUR3_128>();
+}
+
+struct test_t {
+    char const  *name;
+    unsigned   (*run)();
+};
+static test_t const  TESTS[] = {
+    { "modes",      test_modes },
+    { "estimate",   test_estimate },
+    { "moments",    test_moments },
+    { "sparse",     test_sparse },
+    { "weighted",   test_weighted },
+    { "subsets",    test_subsets },
+    { "groups",     test_groups },
+    { "atomic",     test_atomic },
+    { "merge",      test_merge },
+    { "window",     test_window },
+    { "store",      test_store },
+    { "static",     test_static },
+};
+
+int main(int argc, char* argv[]) {
+    unsigned  fails = 0;
+    bool      found = false;
+    for(test_t const &t : TESTS) {
+        if((argc > 1) && strcmp(argv[1], t.name))  continue;
+        found = true;
+        unsigned const  f = t.run();
+        std::cout << t.name << ": " << (f? "FAILED" : "passed") << std::endl;
+        fails += f;
+    }
+    if(!found) {
+        std::cerr << "Unknown test: " << argv[1] << std::endl;
+        return  2;
+    }
+    return  fails? 1 : 0;
+}
@@ -0,0 +1,127 @@
+/**
+ * Copyright (c) 2020, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#include "skt_topology.hpp"
+#include "skt.hpp"
+
+#include <fstream>
+#include <string>
+#include <cstdio>
+#include <algorithm>
+#include <dirent.h>
+#include <pthread.h>
+
+// Parses a sysfs cpu list such as "0-3,8-11"
+static std::vector<unsigned> parse_cpulist(std::string const &path) {
+    std::vector<unsigned>  cpus;
+    std::ifstream  in(path);
+    std::string    tok;
+    while(std::getline(in, tok, ',')) {
+        size_t const    sep = tok.find('-');
+        unsigned const  lo  = std::stoul(tok);
+        unsigned const  hi  = sep == std::string::npos? lo : std::stoul(tok.substr(sep+1));
+        for(unsigned c = lo; c <= hi; c++)  cpus.push_back(c);
+    }
+    return  cpus;
+}
+
+SktTopology::SktTopology() {
+    if(DIR *const  dir = opendir("/sys/devices/system/node")) {
+        std::vector<unsigned>  ids;
+        while(dirent const *const  e = readdir(dir)) {
+            unsigned  id;
+            if(sscanf(e->d_name, "node%u", &id) == 1)  ids.push_back(id);
+        }
+        closedir(dir);
+        std::sort(ids.begin(), ids.end());
+        for(unsigned const id : ids) {
+            std::vector<unsigned>  cpus = parse_cpulist("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+            if(!cpus.empty())  m_cpus.push_back(std::move(cpus));
+        }
+    }
+    if(m_cpus.empty()) {
+        m_cpus.emplace_back();
+        for(unsigned c = 0; c < std::max(1u, std::thread::hardware_concurrency()); c++)  m_cpus.back().push_back(c);
+    }
+
+    // Rank of each cpu among its hyperthread siblings, stable sort puts rank 0 first
+    for(std::vector<unsigned> &cpus : m_cpus) {
+        std::vector<std::pair<unsigned, unsigned>>  ranked;
+        for(unsigned const c : cpus) {
+            std::vector<unsigned> const  sib = parse_cpulist("/sys/devices/system/cpu/cpu" + std::to_string(c) + "/topology/thread_siblings_list");
+            ranked.emplace_back(std::find(sib.begin(), sib.end(), c) - sib.begin(), c);
+        }
+        std::stable_sort(ranked.begin(), ranked.end(), [](std::pair<unsigned, unsigned> const &a, std::pair<unsigned, unsigned> const &b) { return  a.first < b.first; });
+        for(size_t i = 0; i < cpus.size(); i++)  cpus[i] = ranked[i].second;
+    }
+}
+
+SktTopology const& SktTopology::get() {
+    static SktTopology const  topology;
+    return  topology;
+}
+
+void SktTopology::pin_cpu(unsigned const cpu) {
+    cpu_set_t  set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void SktTopology::pin_node(unsigned const node) const {
+    cpu_set_t  set;
+    CPU_ZERO(&set);
+    for(unsigned const c : m_cpus[node])  CPU_SET(c, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void SktTopology::merge(SktCollector *collectors, unsigned const n, unsigned const num_threads) const {
+    if(nodes() < 2) {
+        SktCollector::merge_tree(collectors, n, num_threads);
+        return;
+    }
+
+    // Node-local trees, run by threads bound to their node (merge_tree's
+    // helpers inherit the binding). With fewer threads than nodes some stay empty.
+    std::vector<std::thread>  threads;
+    for(unsigned k = 0; k < nodes(); k++) {
+        unsigned const  lo = first_of(k, n);
+        unsigned const  hi = first_of(k+1, n);
+        if(lo == hi)  continue;
+        unsigned const  t  = std::max(1u, (unsigned)(((size_t)(k+1) * num_threads) / nodes() - ((size_t)k * num_threads) / nodes()));
+        threads.emplace_back([this, collectors, lo, hi, t, k]() {
+            pin_node(k);
+            SktCollector::merge_tree(collectors+lo, hi-lo, t);
+        });
+    }
+    for(std::thread &t : threads)  t.join();
+
+    // Cross-node: one partial per node
+    for(unsigned k = 1; k < nodes(); k++) {
+        unsigned const  lo = first_of(k, n);
+        if((lo > 0) && (lo < first_of(k+1, n)))  collectors[0].merge(collectors[lo]);
+    }
+}
@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2020, Systems Group, ETH Zurich
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without modification,
+ * are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ * this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its contributors
+ * may be used to endorse or promote products derived from this software
+ * without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO,
+ * THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO,
+ * PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+ * HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE,
+ * EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+#ifndef SKT_TOPOLOGY_HPP
+#define SKT_TOPOLOGY_HPP
+
+#include <vector>
+#include <thread>
+
+class SktCollector;
+
+// NUMA topology as read from /sys/devices/system/node. Without NUMA
+// information all online cpus form a single node. Within a node the cpus
+// are ordered so that one hardware thread of every physical core comes first.
+class SktTopology {
+    std::vector<std::vector<unsigned>>  m_cpus;   // cpus of each node
+
+    SktTopology();
+
+public:
+    static SktTopology const& get();
+
+    unsigned nodes() const { return  m_cpus.size(); }
+    std::vector<unsigned> const& cpus(unsigned const node) const { return  m_cpus[node]; }
+
+    // Placement of thread i out of n: the threads are cut into one contiguous
+    // group per node and spread over the physical cores of their node.
+    unsigned node_of(unsigned const i, unsigned const n) const { return  (unsigned)(((size_t)i * nodes()) / n); }
+    unsigned first_of(unsigned const node, unsigned const n) const { return  (unsigned)(((size_t)node * n + nodes()-1) / nodes()); }
+    unsigned cpu_of(unsigned const i, unsigned const n) const {
+        unsigned const  node = node_of(i, n);
+        return  m_cpus[node][(i - first_of(node, n)) % m_cpus[node].size()];
+    }
+
+    // Binds the calling thread to a single cpu or to all cpus of a node,
+    // so that a thread pins itself before it does any work
+    static void pin_cpu(unsigned const cpu);
+    void pin_node(unsigned const node) const;
+
+    // Merges the collectors of n threads placed by node_of into collectors[0]:
+    // first within each node by threads bound to that node, then across nodes.
+    void merge(SktCollector *collectors, unsigned const n, unsigned const num_threads) const;
+};
+#endif
@@ -1,19 +1,34 @@
 #include <iostream>
 #include <fstream>
+#include <cstdint>
+#include <cstdlib>
 
 int main(int const  argc, char const *const  argv[]) {
-	if(argc != 3) {
-		std::cerr << argv[0] << " <file.txt> <file.bin>" << std::endl;
+	if((argc < 3) || (4 < argc)) {
+		std::cerr << argv[0] << " <file.txt> <file.bin> [<key_bits:32/64>]" << std::endl;
+		return -1;
+	}
+	unsigned const  key_bits = (argc > 3)? atoi(argv[3]) : 32;
+	if((key_bits != 32) && (key_bits != 64)) {
+		std::cerr << "Key bits must be 32 or 64." << std::endl;
 		return -1;
 	}
 
 	std::ifstream  ifs(argv[1]);
 	std::ofstream  ofs(argv[2], std::ios::binary);
 	while(true) {
-		uint32_t  v;
+		uint64_t  v;
 		ifs >> v;
 		if(!ifs)  break;
-		ofs.write((char const*)&v, sizeof(v));
+		if(key_bits == 32) {
+			if(v > UINT32_MAX) {
+				std::cerr << "Key " << v << " does not fit 32 bits." << std::endl;
+				return -1;
+			}
+			uint32_t const  w = v;
+			ofs.write((char const*)&w, sizeof(w));
+		}
+		else  ofs.write((char const*)&v, sizeof(v));
 	}
 
 }
\ No newline at end of file